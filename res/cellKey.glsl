@@ -0,0 +1,13 @@
+// Linear cell index of a voxel, x fastest (as in the active cell list). Needs GRID_RES.
+const uint NO_CELL = 0xFFFFFFFFu;
+
+uint cellKey(ivec3 voxelId)
+{
+  return uint(voxelId.x + GRID_RES.x * (voxelId.y + GRID_RES.y * voxelId.z));
+}
+
+ivec3 cellCoord(uint key)
+{
+  const uvec3 gridRes = uvec3(GRID_RES);
+  return ivec3(key % gridRes.x, (key / gridRes.x) % gridRes.y, key / (gridRes.x * gridRes.y));
+}
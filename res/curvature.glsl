@@ -0,0 +1,39 @@
+// Screen space curvature flow (van der Laan et al. 2009) on window depth, shared by the fragment
+// shader and the tiled compute shader. Needs depth.glsl.
+const float Z_THRESHOLD = 5.0;
+const float SMOOTH_DT = 0.0005;
+
+// Large eye space depth changes towards the direct neighbors (right, left, top, bottom) are
+// silhouettes, which are not smoothed.
+bool depthDiscontinuity(float z, vec4 neighbors)
+{
+  const vec4 zDiff = abs(depthToEyeSpaceZ(z) - depthToEyeSpaceZ(neighbors));
+  return any(greaterThan(zDiff, vec4(Z_THRESHOLD)));
+}
+
+// One step of the flow from the direct neighbors and the first derivatives.
+float curvatureFlow(float z, vec4 neighbors, float dzdx, float dzdy, float dzdxy, mat4 projection, ivec2 res)
+{
+  // Equation (3)
+  const float Fx = -projection[0][0]; // 2n / (r-l)
+  const float Fy = -projection[1][1]; // 2n / (t-b)
+  const float Cx = 2.0 / (res.x * Fx);
+  const float Cy = 2.0 / (res.y * Fy);
+  const float Cy2 = Cy * Cy;
+  const float Cx2 = Cx * Cx;
+
+  // Equation (5)
+  const float D = Cy2 * (dzdx * dzdx) + Cx2 * (dzdy * dzdy) + Cx2 * Cy2 * (z * z);
+
+  const float dzdx2 = neighbors.x + neighbors.y - z * 2.0;
+  const float dzdy2 = neighbors.z + neighbors.w - z * 2.0;
+  const float dDdx = 2.0 * Cy2 * dzdx * dzdx2 + 2.0 * Cx2 * dzdy * dzdxy + 2.0 * Cx2 * Cy2 * z * dzdx;
+  const float dDdy = 2.0 * Cy2 * dzdx * dzdxy + 2.0 * Cx2 * dzdy * dzdy2 + 2.0 * Cx2 * Cy2 * z * dzdy;
+
+  // Mean Curvature (7)(8)(6)
+  const float Ex = 0.5 * dzdx * dDdx - dzdx2 * D;
+  const float Ey = 0.5 * dzdy * dDdy - dzdy2 * D;
+  const float H2 = (Cy * Ex + Cx * Ey) / pow(D, 3.0 / 2.0);
+
+  return z + (0.5 * H2) * SMOOTH_DT;
+}
@@ -0,0 +1,56 @@
+// Conversions between window depth and eye space depth, and the depth encodings of the
+// smoothing targets (Simulation::Options::smoothingFormat).
+const float NEAR = 0.01;
+const float FAR = 25.0;
+
+const int DEPTH_ENCODING_WINDOW = 0;
+const int DEPTH_ENCODING_COMPLEMENTARY = 1;
+const int DEPTH_ENCODING_LINEAR = 2;
+
+float depthToEyeSpaceZ(float depth)
+{
+  const float ndc = 2.0 * depth - 1.0;
+  return 2.0 * NEAR * FAR / (FAR + NEAR - ndc * (FAR - NEAR));
+}
+
+vec4 depthToEyeSpaceZ(vec4 depth)
+{
+  const vec4 ndc = 2.0 * depth - 1.0;
+  return 2.0 * NEAR * FAR / (FAR + NEAR - ndc * (FAR - NEAR));
+}
+
+float eyeSpaceZToDepth(float eyeZ)
+{
+  const float ndc = (FAR + NEAR - 2.0 * NEAR * FAR / eyeZ) / (FAR - NEAR);
+  return 0.5 * ndc + 0.5;
+}
+
+// Smoothing targets store complementary depth (1 - z, keeps half float precision near the far
+// plane) or linear eye depth over the far plane (for 16 bit normalized targets).
+float decodeDepth(float value, int encoding)
+{
+  if (encoding == DEPTH_ENCODING_COMPLEMENTARY)
+  {
+    return 1.0 - value;
+  }
+  else if (encoding == DEPTH_ENCODING_LINEAR)
+  {
+    return (value >= 1.0) ? 1.0 : eyeSpaceZToDepth(value * FAR);
+  }
+
+  return value;
+}
+
+float encodeDepth(float depth, int encoding)
+{
+  if (encoding == DEPTH_ENCODING_COMPLEMENTARY)
+  {
+    return 1.0 - depth;
+  }
+  else if (encoding == DEPTH_ENCODING_LINEAR)
+  {
+    return (depth >= 1.0) ? 1.0 : depthToEyeSpaceZ(depth) / FAR;
+  }
+
+  return depth;
+}
@@ -0,0 +1,96 @@
+// Particle ranges of the occupied neighbor cells, taken off the occupancy bits of
+// neighborhoodOccupancy (see occupancy.glsl). Needs the grid image, GRID_RES, SLEEPING and
+// neighborhood.glsl.
+//
+// With ROW_RANGES the particles are sorted by cell key (radix sort), so the occupied cells of a
+// row along x are contiguous: each range covers a whole row, from its first to its last occupied
+// cell, and takes at most two grid loads. Otherwise each range is a single cell.
+//
+// After incremental steps, particles are still listed in the cells of the last full sort. If
+// any left its binned cell, the search walks every cell of a block widened by that drift.
+
+layout(binding = 3, std430) restrict readonly buffer counters
+{
+  uint globalParticleCount;
+  uint staleParticleCount;
+  uint maxCellDrift;
+};
+
+struct NeighborCursor
+{
+  uint occupied;
+  int radius;
+  int cell;
+  int cellCount;
+};
+
+NeighborCursor beginNeighborRanges(ivec3 voxelId)
+{
+  NeighborCursor cursor = NeighborCursor(0u, 0, 0, 0);
+
+  if (maxCellDrift == 0)
+  {
+    cursor.occupied = neighborhoodOccupancy(voxelId);
+    return cursor;
+  }
+
+#if SLEEPING
+  // Sleeping centers the search on the binned cell, which the particle itself may have left.
+  cursor.radius = 1 + 2 * int(maxCellDrift);
+#else
+  cursor.radius = 1 + int(maxCellDrift);
+#endif
+  const int side = 2 * cursor.radius + 1;
+  cursor.cellCount = side * side * side;
+
+  return cursor;
+}
+
+bool hasNeighborRange(NeighborCursor cursor)
+{
+  return cursor.occupied != 0 || cursor.cell < cursor.cellCount;
+}
+
+uvec2 nextNeighborRange(ivec3 voxelId, inout NeighborCursor cursor)
+{
+  if (cursor.occupied == 0)
+  {
+    // Widened block: one cell at a time, cells outside the grid give an empty range.
+    const int side = 2 * cursor.radius + 1;
+    const ivec3 neighborId = voxelId - cursor.radius + ivec3(cursor.cell % side, (cursor.cell / side) % side, cursor.cell / (side * side));
+    ++cursor.cell;
+
+    if (any(lessThan(neighborId, ivec3(0))) || any(greaterThanEqual(neighborId, GRID_RES)))
+    {
+      return uvec2(0);
+    }
+
+    const uint voxelValue = imageLoad(grid, neighborId).r;
+
+    return uvec2(voxelValue >> 8, (voxelValue >> 8) + (voxelValue & 0xFFu));
+  }
+
+  uint occupied = cursor.occupied;
+  const int first = findLSB(occupied);
+
+#if ROW_RANGES
+  const uint rowEnd = uint(first / 3 + 1) * 3u;
+  const uint rowCells = occupied & ((1u << rowEnd) - 1u);
+  const int last = findMSB(rowCells);
+  occupied &= ~rowCells;
+
+  const uint firstValue = imageLoad(grid, voxelId + NEIGHBORHOOD_LUT[first]).r;
+  const uint lastValue = (last == first) ? firstValue : imageLoad(grid, voxelId + NEIGHBORHOOD_LUT[last]).r;
+
+  cursor.occupied = occupied;
+
+  return uvec2(firstValue >> 8, (lastValue >> 8) + (lastValue & 0xFFu));
+#else
+  occupied &= occupied - 1u;
+  cursor.occupied = occupied;
+
+  const uint voxelValue = imageLoad(grid, voxelId + NEIGHBORHOOD_LUT[first]).r;
+
+  return uvec2(voxelValue >> 8, (voxelValue >> 8) + (voxelValue & 0xFFu));
+#endif
+}
@@ -0,0 +1,12 @@
+// Offsets of a voxel and its 26 neighbors, for neighbor searches on the uniform grid.
+const ivec3 NEIGHBORHOOD_LUT[27] = {
+  ivec3(-1, -1, -1), ivec3(0, -1, -1), ivec3(1, -1, -1),
+  ivec3(-1, -1,  0), ivec3(0, -1,  0), ivec3(1, -1,  0),
+  ivec3(-1, -1,  1), ivec3(0, -1,  1), ivec3(1, -1,  1),
+  ivec3(-1,  0, -1), ivec3(0,  0, -1), ivec3(1,  0, -1),
+  ivec3(-1,  0,  0), ivec3(0,  0,  0), ivec3(1,  0,  0),
+  ivec3(-1,  0,  1), ivec3(0,  0,  1), ivec3(1,  0,  1),
+  ivec3(-1,  1, -1), ivec3(0,  1, -1), ivec3(1,  1, -1),
+  ivec3(-1,  1,  0), ivec3(0,  1,  0), ivec3(1,  1,  0),
+  ivec3(-1,  1,  1), ivec3(0,  1,  1), ivec3(1,  1,  1)
+};
@@ -0,0 +1,91 @@
+// Occupancy of the grid cells (one bit per cell) and of the bricks (blocks of the grid work group
+// size, one bit per brick), rebuilt with every full sort. Bit key + 1 holds cell key, so the
+// cells left and right of every cell have a bit. Needs GRID_RES, BRICK_RES, the grid work group
+// size and cellKey.glsl. Shaders that build the masks define OCCUPANCY_WRITE.
+#if OCCUPANCY_WRITE
+#define OCCUPANCY_ACCESS
+#else
+#define OCCUPANCY_ACCESS readonly
+#endif
+
+layout(binding = 17, std430) restrict OCCUPANCY_ACCESS buffer occupancyBuf
+{
+  uint occupancy[];
+};
+
+layout(binding = 18, std430) restrict OCCUPANCY_ACCESS buffer brickOccupancyBuf
+{
+  uint brickOccupancy[];
+};
+
+uint brickKey(ivec3 voxelId)
+{
+  const ivec3 brick = voxelId / ivec3(GRID_GROUP_SIZE_X, GRID_GROUP_SIZE_Y, GRID_GROUP_SIZE_Z);
+  return uint(brick.x + BRICK_RES.x * (brick.y + BRICK_RES.y * brick.z));
+}
+
+bool brickOccupied(uint brick)
+{
+  return (brickOccupancy[brick >> 5] & (1u << (brick & 31u))) != 0;
+}
+
+#if OCCUPANCY_WRITE
+void markOccupied(uint key)
+{
+  const uint bit = key + 1u;
+  atomicOr(occupancy[bit >> 5], 1u << (bit & 31u));
+}
+
+void markBrickOccupied(uint brick)
+{
+  atomicOr(brickOccupancy[brick >> 5], 1u << (brick & 31u));
+}
+#else
+// Occupied cells of a voxel and its 26 neighbors, bit i for NEIGHBORHOOD_LUT[i]. The three cells
+// of a row along x are read from one or two words.
+uint neighborhoodOccupancy(ivec3 voxelId)
+{
+  // Neighbors outside the grid along x alias cells of the adjacent rows.
+  uint rowMask = 7u;
+
+  if (voxelId.x == 0)
+  {
+    rowMask &= ~1u;
+  }
+
+  if (voxelId.x == GRID_RES.x - 1)
+  {
+    rowMask &= ~4u;
+  }
+
+  uint bits = 0;
+
+  for (int dy = -1; dy <= 1; ++dy)
+  {
+    for (int dz = -1; dz <= 1; ++dz)
+    {
+      const ivec2 rowId = voxelId.yz + ivec2(dy, dz);
+
+      if (any(lessThan(rowId, ivec2(0))) || any(greaterThanEqual(rowId, GRID_RES.yz)))
+      {
+        continue;
+      }
+
+      // The bit of the row center is key + 1, its left neighbor is at key.
+      const uint first = cellKey(ivec3(voxelId.x, rowId));
+      const uint word = first >> 5;
+      const uint shift = first & 31u;
+      uint row = occupancy[word] >> shift;
+
+      if (shift > 29u)
+      {
+        row |= occupancy[word + 1] << (32u - shift);
+      }
+
+      bits |= (row & rowMask) << (3 * ((dz + 1) + 3 * (dy + 1)));
+    }
+  }
+
+  return bits;
+}
+#endif
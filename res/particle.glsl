@@ -0,0 +1,8 @@
+// Particle layout shared by all particle buffers, see Particle in Simulation.cpp.
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
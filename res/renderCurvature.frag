@@ -2,59 +2,52 @@
 
 #extension GL_ARB_bindless_texture: require
 
-const float Z_THRESHOLD = 5.0;
-const float SMOOTH_DT = 0.0005;
-const float NEAR = 0.01;
-const float FAR = 25.0;
-
 layout (location = 0) uniform mat4 MVP;
 layout (location = 1, bindless_sampler) uniform sampler2D depthTex;
 layout (location = 2) uniform mat4 projection;
 layout (location = 3) uniform ivec2 res;
+layout (location = 4) uniform int inputEncoding;
+layout (location = 5) uniform int outputEncoding;
 
 out float finalDepth;
 
-float depthToEyeSpaceZ(float depth)
-{
-  const float ndc = 2.0 * depth - 1.0;
-  return 2.0 * NEAR * FAR / (FAR + NEAR - ndc * (FAR - NEAR));
-}
+#include "depth.glsl"
+
+#include "curvature.glsl"
 
-vec4 depthToEyeSpaceZ(vec4 depth)
+float loadDepth(vec2 coords)
 {
-  const vec4 ndc = 2.0 * depth - 1.0;
-  return 2.0 * NEAR * FAR / (FAR + NEAR - ndc * (FAR - NEAR));
+  return decodeDepth(texture(depthTex, coords).x, inputEncoding);
 }
 
 void main(void)
 {
-  const vec2 coords = gl_FragCoord.xy / res;
-  const float z = texture(depthTex, coords).x;
+  const vec2 texelSize = 1.0 / vec2(textureSize(depthTex, 0));
+  const vec2 coords = gl_FragCoord.xy * texelSize;
+  const float z = loadDepth(coords);
 
   if (z == 1.0)
   {
-    finalDepth = 1.0;
+    finalDepth = encodeDepth(1.0, outputEncoding);
     return;
   }
 
   // Gradient step
-  const vec2 dx = vec2(1.0 / res.x, 0.0);
-  const vec2 dy = vec2(0.0, 1.0 / res.y);
+  const vec2 dx = vec2(texelSize.x, 0.0);
+  const vec2 dy = vec2(0.0, texelSize.y);
 
   // Direct neighbors (dz/dx)
-  const float right = texture(depthTex, coords + dx).x;
-  const float left = texture(depthTex, coords - dx).x;
-  const float top = texture(depthTex, coords + dy).x;
-  const float bottom = texture(depthTex, coords - dy).x;
+  const float right = loadDepth(coords + dx);
+  const float left = loadDepth(coords - dx);
+  const float top = loadDepth(coords + dy);
+  const float bottom = loadDepth(coords - dy);
 
   // Disallow large changes in depth
-  const float eyeZ = depthToEyeSpaceZ(z);
-  const vec4 neighborEyeZ = depthToEyeSpaceZ(vec4(right, left, top, bottom));
-  const vec4 zDiff = abs(eyeZ - neighborEyeZ);
+  const vec4 neighbors = vec4(right, left, top, bottom);
 
-  if (any(greaterThan(zDiff, vec4(Z_THRESHOLD))))
+  if (depthDiscontinuity(z, neighbors))
   {
-    finalDepth = z;
+    finalDepth = encodeDepth(z, outputEncoding);
     return;
   }
 
@@ -65,34 +58,13 @@ void main(void)
                       top == 1.0 || bottom == 1.0) ? 0.0 : 0.5 * (top - bottom);
 
   // Diagonal neighbors
-  const float topRight = texture(depthTex, coords + dx + dy).x;
-  const float bottomLeft = texture(depthTex, coords - dx - dy).x;
-  const float bottomRight = texture(depthTex, coords + dx - dy).x;
-  const float topLeft = texture(depthTex, coords - dx + dy).x;
+  const float topRight = loadDepth(coords + dx + dy);
+  const float bottomLeft = loadDepth(coords - dx - dy);
+  const float bottomRight = loadDepth(coords + dx - dy);
+  const float topLeft = loadDepth(coords - dx + dy);
 
   // Use central difference (for better results)
   const float dzdxy = (+topRight + bottomLeft - bottomRight - topLeft) * 0.25;
 
-  // Equation (3)
-  const float Fx = -projection[0][0]; // 2n / (r-l)
-  const float Fy = -projection[1][1]; // 2n / (t-b)
-  const float Cx = 2.0 / (res.x * Fx);
-  const float Cy = 2.0 / (res.y * Fy);
-  const float Cy2 = Cy * Cy;
-  const float Cx2 = Cx * Cx;
-
-  // Equation (5)
-  const float D = Cy2 * (dzdx * dzdx) + Cx2 * (dzdy * dzdy) + Cx2 * Cy2 * (z * z);
-
-  const float dzdx2 = right + left - z * 2.0;
-  const float dzdy2 = top + bottom - z * 2.0;
-  const float dDdx = 2.0 * Cy2 * dzdx * dzdx2 + 2.0 * Cx2 * dzdy * dzdxy + 2.0 * Cx2 * Cy2 * z * dzdx;
-  const float dDdy = 2.0 * Cy2 * dzdx * dzdxy + 2.0 * Cx2 * dzdy * dzdy2 + 2.0 * Cx2 * Cy2 * z * dzdy;
-
-  // Mean Curvature (7)(8)(6)
-  const float Ex = 0.5 * dzdx * dDdx - dzdx2 * D;
-  const float Ey = 0.5 * dzdy * dDdy - dzdy2 * D;
-  const float H2 = (Cy * Ex + Cx * Ey) / pow(D, 3.0 / 2.0);
-
-  finalDepth = z + (0.5 * H2) * SMOOTH_DT;
+  finalDepth = encodeDepth(curvatureFlow(z, neighbors, dzdx, dzdy, dzdxy, projection, res), outputEncoding);
 }
@@ -0,0 +1,41 @@
+#version 460 core
+
+const vec3 LIGHT_POS = vec3(0.0, 1.0, 0.0);
+const float AMBIENT_COEFF = 0.3;
+const float SHININESS = 25.0;
+
+layout (location = 1) uniform mat4 view;
+layout (location = 2) uniform vec3 color;
+
+in vec3 eyeSpacePos;
+in vec3 eyeSpaceNormal;
+
+out vec4 finalColor;
+
+void main()
+{
+  // Light both sides, the mesh is open where it touches the domain boundary.
+  vec3 normal = normalize(eyeSpaceNormal);
+
+  if (!gl_FrontFacing)
+  {
+    normal = -normal;
+  }
+
+  // Diffuse
+  const vec3 lightPosEye = (view * vec4(LIGHT_POS, 1.0)).xyz;
+  const vec3 lightDir = normalize(lightPosEye - eyeSpacePos);
+  const float dcoeff = max(0.0, dot(normal, lightDir));
+  const vec3 diffColor = color * dcoeff;
+
+  // Specular (Blinn-Phong)
+  const vec3 viewDir = normalize(-eyeSpacePos);
+  const vec3 halfDir = normalize(lightDir + viewDir);
+  const float cosAngle = max(dot(halfDir, normal), 0.0);
+  const float scoeff = pow(cosAngle, SHININESS);
+  const vec3 specColor = vec3(1.0) * scoeff;
+
+  // Final
+  const vec3 ambientColor = AMBIENT_COEFF * color;
+  finalColor = vec4(ambientColor + diffColor + specColor, 1.0);
+}
@@ -0,0 +1,17 @@
+#version 460 core
+
+layout (location = 0) in vec4 vertPos;
+layout (location = 1) in vec4 vertNormal;
+
+layout (location = 0) uniform mat4 MVP;
+layout (location = 1) uniform mat4 view;
+
+out vec3 eyeSpacePos;
+out vec3 eyeSpaceNormal;
+
+void main()
+{
+  eyeSpacePos = (view * vertPos).xyz;
+  eyeSpaceNormal = mat3(view) * vertNormal.xyz;
+  gl_Position = MVP * vertPos;
+}
@@ -1,6 +1,6 @@
 #version 460 core
 
-#extension ARB_bindless_texture: require
+#extension GL_ARB_bindless_texture: require
 
 const vec3 LIGHT_POS = vec3(0.0, 1.0, 0.0);
 const float AMBIENT_COEFF = 0.3;
@@ -13,15 +13,28 @@ layout (location = 3) uniform uint width;
 layout (location = 4) uniform uint height;
 layout (location = 5) uniform mat4 invProjection;
 layout (location = 6) uniform mat4 view;
+layout (location = 7) uniform vec2 uvScale;
+layout (location = 8) uniform int depthEncoding;
 
 out vec4 finalColor;
 
+#include "depth.glsl"
+
+float loadDepth(vec2 coord)
+{
+  return decodeDepth(texture(depthTex, coord).x, depthEncoding);
+}
+
 vec3 getEyePos(vec2 coord)
 {
-  const float viewportDepth = texture(depthTex, coord).x;
+  // Stay inside the rendered part of the texture.
+  const vec2 halfTexel = 0.5 / vec2(textureSize(depthTex, 0));
+  coord = clamp(coord, halfTexel, uvScale - halfTexel);
+
+  const float viewportDepth = loadDepth(coord);
 
   const float ndcDepth = viewportDepth * 2.0 - 1.0;
-  const vec4 clipSpacePos = vec4(coord * 2.0 - vec2(1.0), ndcDepth, 1.0);
+  const vec4 clipSpacePos = vec4((coord / uvScale) * 2.0 - vec2(1.0), ndcDepth, 1.0);
   const vec4 eyeSpacePos = invProjection * clipSpacePos;
 
   return eyeSpacePos.xyz / eyeSpacePos.w;
@@ -29,17 +42,23 @@ vec3 getEyePos(vec2 coord)
 
 void main()
 {
-  // Retrieve values from GBuffer
-  const vec2 texelSize = 1.0 / vec2(width, height);
-  const vec2 coord = gl_FragCoord.xy * texelSize;
+  // Retrieve values from GBuffer. The GBuffer may have been rendered at a lower resolution,
+  // so snap to the nearest rendered texel (filtering depth would create false silhouettes).
+  const vec2 texSize = vec2(textureSize(depthTex, 0));
+  const vec2 texelSize = 1.0 / texSize;
+  const vec2 renderPixel = floor(gl_FragCoord.xy / vec2(width, height) * uvScale * texSize);
+  const vec2 coord = (renderPixel + 0.5) * texelSize;
 
-  const float viewportDepth = texture(depthTex, coord).x;
+  const float viewportDepth = loadDepth(coord);
 
   if (viewportDepth == 1.0)
   {
     discard;
   }
 
+  // Depth test against opaque geometry (obstacles) in the backbuffer.
+  gl_FragDepth = viewportDepth;
+
   // Reconstruct position from depth
   const vec3 eyeSpacePos = getEyePos(coord);
 
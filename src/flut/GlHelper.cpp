@@ -1,6 +1,47 @@
 #include "GlHelper.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+  bool useBindless = true;
+
+  // Classic image handles: texture name, image format, access and layering.
+  constexpr int IMAGE_FORMAT_SHIFT = 32;
+  constexpr int IMAGE_ACCESS_SHIFT = 48;
+  constexpr int IMAGE_LAYERED_SHIFT = 50;
+
+  // GL_KHR_shader_subgroup queries.
+  constexpr GLenum SUBGROUP_SUPPORTED_STAGES_KHR = 0x9533;
+  constexpr GLenum SUBGROUP_SUPPORTED_FEATURES_KHR = 0x9534;
+
+  // A free function, GCC cannot convert variadic lambdas to function pointers.
+  void glPostCallback(const char* name, void* funcptr, int len_args, ...)
+  {
+    if (!std::strcmp(name, "glGetError")) {
+      return;
+    }
+    GLenum errorCode = glGetError();
+    if (errorCode != GL_NO_ERROR) {
+      do {
+        std::printf("GL/ERROR: 0x%04x in %s\n", errorCode, name);
+      } while ((errorCode = glGetError()) != GL_NO_ERROR);
+    }
+  }
+
+  void eraseAll(std::string& text, const std::string& pattern)
+  {
+    for (std::size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos))
+    {
+      text.erase(pos, pattern.size());
+    }
+  }
+}
 
 void GlHelper::enableDebugHooks()
 {
@@ -20,17 +61,7 @@ void GlHelper::enableDebugHooks()
     std::printf("Debug output not available (context flag not set).\n");
   }
 
-  glad_set_post_callback((GLADcallback)[](const char* name, void* funcptr, int len_args, ...) {
-    if (!strcmp(name, "glGetError")) {
-      return;
-    }
-    GLenum errorCode = glGetError();
-    if (errorCode != GL_NO_ERROR) {
-      do {
-        std::printf("GL/ERROR: 0x%04x in %s\n", errorCode, name);
-      } while ((errorCode = glGetError()) != GL_NO_ERROR);
-    }
-  });
+  glad_set_post_callback(&glPostCallback);
 }
 
 void GlHelper::loadFileText(const std::string& filePath, std::vector<char>& text)
@@ -45,7 +76,218 @@ void GlHelper::loadFileText(const std::string& filePath, std::vector<char>& text
   file.read(text.data(), text.size());
 }
 
-GLuint GlHelper::createVertFragShader(const char* vertPath, const char* fragPath)
+std::string GlHelper::resolveIncludes(const std::string& path, std::size_t sourceIndex, std::vector<std::string>& included)
+{
+  std::vector<char> text;
+  loadFileText(path, text);
+  const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+  std::istringstream lines(std::string(text.begin(), text.end()));
+  std::string result;
+  std::string line;
+  std::size_t lineNumber = 0;
+
+  while (std::getline(lines, line))
+  {
+    ++lineNumber;
+    const std::size_t directivePos = line.find_first_not_of(" \t");
+
+    if (directivePos == std::string::npos || line.compare(directivePos, 8, "#include") != 0)
+    {
+      result += line;
+      result += '\n';
+      continue;
+    }
+
+    const std::size_t nameBegin = line.find('"', directivePos);
+    const std::size_t nameEnd = (nameBegin != std::string::npos) ? line.find('"', nameBegin + 1) : std::string::npos;
+
+    if (nameEnd == std::string::npos) {
+      throw std::runtime_error("Malformed #include in " + path + ":" + std::to_string(lineNumber));
+    }
+
+    const std::string includePath = directory + line.substr(nameBegin + 1, nameEnd - nameBegin - 1);
+
+    if (std::find(included.begin(), included.end(), includePath) != included.end())
+    {
+      result += '\n';
+      continue;
+    }
+
+    // Compiler messages refer to the included file by its source string number.
+    included.push_back(includePath);
+    const std::size_t includeIndex = included.size() - 1;
+    result += "#line 1 " + std::to_string(includeIndex) + "\n";
+    result += resolveIncludes(includePath, includeIndex, included);
+    result += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceIndex) + "\n";
+  }
+
+  return result;
+}
+
+void GlHelper::preprocessSource(const std::string& path, const Defines& defines, std::vector<char>& text)
+{
+  std::vector<std::string> included{ path };
+  std::string source = resolveIncludes(path, 0, included);
+
+  // Definitions go right behind the #version directive, the #line directive keeps the line numbers.
+  const std::size_t versionPos = source.find("#version");
+  if (!defines.empty() && versionPos != std::string::npos)
+  {
+    const std::size_t versionEnd = source.find('\n', versionPos);
+    const std::size_t nextLine = std::count(source.begin(), source.begin() + versionEnd, '\n') + 2;
+    std::string definitions;
+
+    for (const auto& define : defines)
+    {
+      definitions += "#define " + define.first + " " + define.second + "\n";
+    }
+
+    definitions += "#line " + std::to_string(nextLine) + " 0\n";
+    source.insert(versionEnd + 1, definitions);
+  }
+
+  // Software rasterizers may only provide OpenGL 4.5, none of the shaders need GLSL 4.60 features.
+  if (GLVersion.major == 4 && GLVersion.minor < 6)
+  {
+    const std::size_t versionPos = source.find("#version 460");
+    if (versionPos != std::string::npos)
+    {
+      source.replace(versionPos, 12, "#version 450");
+    }
+  }
+
+  if (useBindless)
+  {
+    text.assign(source.begin(), source.end());
+    return;
+  }
+
+  const std::string extension = "#extension GL_ARB_bindless_texture: require";
+  const std::size_t extensionPos = source.find(extension);
+  if (extensionPos != std::string::npos)
+  {
+    source.erase(extensionPos, extension.size());
+  }
+
+  eraseAll(source, ", bindless_image");
+  eraseAll(source, ", bindless_sampler");
+  text.assign(source.begin(), source.end());
+}
+
+void GlHelper::setBindless(bool bindless)
+{
+  useBindless = bindless;
+}
+
+bool GlHelper::bindless()
+{
+  return useBindless;
+}
+
+GLuint64 GlHelper::createTextureHandle(GLuint texture)
+{
+  if (!useBindless)
+  {
+    return texture;
+  }
+
+  const GLuint64 handle = glGetTextureHandleARB(texture);
+  glMakeTextureHandleResidentARB(handle);
+  return handle;
+}
+
+GLuint64 GlHelper::createImageHandle(GLuint texture, GLboolean layered, GLenum format, GLenum access)
+{
+  if (!useBindless)
+  {
+    return GLuint64(texture) |
+           (GLuint64(format) << IMAGE_FORMAT_SHIFT) |
+           (GLuint64(access - GL_READ_ONLY) << IMAGE_ACCESS_SHIFT) |
+           (GLuint64(layered ? 1 : 0) << IMAGE_LAYERED_SHIFT);
+  }
+
+  const GLuint64 handle = glGetImageHandleARB(texture, 0, layered, 0, format);
+  glMakeImageHandleResidentARB(handle, access);
+  return handle;
+}
+
+void GlHelper::deleteTextureHandle(GLuint64 handle)
+{
+  if (useBindless)
+  {
+    glMakeTextureHandleNonResidentARB(handle);
+  }
+}
+
+void GlHelper::deleteImageHandle(GLuint64 handle)
+{
+  if (useBindless)
+  {
+    glMakeImageHandleNonResidentARB(handle);
+  }
+}
+
+void GlHelper::setTextureUniform(GLuint program, GLint location, GLuint64 handle)
+{
+  if (useBindless)
+  {
+    glProgramUniformHandleui64ARB(program, location, handle);
+    return;
+  }
+
+  glBindTextureUnit(location, static_cast<GLuint>(handle));
+  glProgramUniform1i(program, location, location);
+}
+
+void GlHelper::setImageUniform(GLuint program, GLint location, GLuint64 handle)
+{
+  if (useBindless)
+  {
+    glProgramUniformHandleui64ARB(program, location, handle);
+    return;
+  }
+
+  const GLuint texture = static_cast<GLuint>(handle & 0xffffffff);
+  const GLenum format = static_cast<GLenum>((handle >> IMAGE_FORMAT_SHIFT) & 0xffff);
+  const GLenum access = GL_READ_ONLY + static_cast<GLenum>((handle >> IMAGE_ACCESS_SHIFT) & 0x3);
+  const GLboolean layered = ((handle >> IMAGE_LAYERED_SHIFT) & 1) ? GL_TRUE : GL_FALSE;
+  glBindImageTexture(location, texture, 0, layered, 0, access, format);
+  glProgramUniform1i(program, location, location);
+}
+
+bool GlHelper::hasExtension(const char* name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+  for (GLint i = 0; i < count; ++i)
+  {
+    if (!std::strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), name))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool GlHelper::computeSubgroupSupport(GLbitfield features)
+{
+  if (!hasExtension("GL_KHR_shader_subgroup"))
+  {
+    return false;
+  }
+
+  GLint stages = 0;
+  GLint supportedFeatures = 0;
+  glGetIntegerv(SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+  glGetIntegerv(SUBGROUP_SUPPORTED_FEATURES_KHR, &supportedFeatures);
+
+  return (stages & GL_COMPUTE_SHADER_BIT) && (static_cast<GLbitfield>(supportedFeatures) & features) == features;
+}
+
+GLuint GlHelper::createVertFragShader(const char* vertPath, const char* fragPath, const Defines& defines)
 {
   GLuint handle = glCreateProgram();
 
@@ -54,7 +296,7 @@ GLuint GlHelper::createVertFragShader(const char* vertPath, const char* fragPath
   }
 
   std::vector<char> vertSource;
-  loadFileText(vertPath, vertSource);
+  preprocessSource(vertPath, defines, vertSource);
 
   const GLuint vertHandle = glCreateShader(GL_VERTEX_SHADER);
   const GLint vertSize = vertSource.size();
@@ -79,7 +321,7 @@ GLuint GlHelper::createVertFragShader(const char* vertPath, const char* fragPath
   }
 
   std::vector<char> fragSource;
-  loadFileText(fragPath, fragSource);
+  preprocessSource(fragPath, defines, fragSource);
 
   const GLuint fragHandle = glCreateShader(GL_FRAGMENT_SHADER);
   const GLint fragSize = fragSource.size();
@@ -126,7 +368,7 @@ GLuint GlHelper::createVertFragShader(const char* vertPath, const char* fragPath
   return handle;
 }
 
-GLuint GlHelper::createComputeShader(const char* path)
+GLuint GlHelper::createComputeShader(const char* path, const Defines& defines)
 {
   const GLuint handle = glCreateProgram();
 
@@ -135,7 +377,7 @@ GLuint GlHelper::createComputeShader(const char* path)
   }
 
   std::vector<char> source;
-  loadFileText(path, source);
+  preprocessSource(path, defines, source);
 
   const GLuint sourceHandle = glCreateShader(GL_COMPUTE_SHADER);
   const GLint sourceSize = source.size();
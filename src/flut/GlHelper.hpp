@@ -1,21 +1,67 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 #include <glad/glad.h>
 
 class GlHelper
 {
+public:
+  // Preprocessor definitions (name, value) injected behind the #version directive of a shader.
+  using Defines = std::vector<std::pair<std::string, std::string>>;
+
 public:
   static void enableDebugHooks();
 
-  static GLuint createVertFragShader(const char* vertPath, const char* fragPath);
+  // Shader sources may include other files with #include "file", relative to the including file.
+  // Each file is included once per shader.
+  static GLuint createVertFragShader(const char* vertPath, const char* fragPath, const Defines& defines = {});
+
+  static GLuint createComputeShader(const char* path, const Defines& defines = {});
+
+  // Textures and images are bound either through resident ARB_bindless_texture handles or, where
+  // the extension is missing, through classic texture and image units. The classic path uses the
+  // uniform location as unit and encodes the texture (and image format) in the handle value, so
+  // the callers store and pass handles the same way on both paths. Selected once at startup.
+  static void setBindless(bool bindless);
+
+  // Image units the classic path needs, one more than the highest image uniform location.
+  static constexpr GLint CLASSIC_IMAGE_UNITS = 14;
+
+  static bool bindless();
+
+  static GLuint64 createTextureHandle(GLuint texture);
+
+  static GLuint64 createImageHandle(GLuint texture, GLboolean layered, GLenum format, GLenum access);
 
-  static GLuint createComputeShader(const char* path);
+  static void deleteTextureHandle(GLuint64 handle);
+
+  static void deleteImageHandle(GLuint64 handle);
+
+  static void setTextureUniform(GLuint program, GLint location, GLuint64 handle);
+
+  static void setImageUniform(GLuint program, GLint location, GLuint64 handle);
+
+  // GL_KHR_shader_subgroup feature bits (not part of the generated loader).
+  static constexpr GLbitfield SUBGROUP_FEATURE_BASIC = 0x1;
+  static constexpr GLbitfield SUBGROUP_FEATURE_ARITHMETIC = 0x4;
+  static constexpr GLbitfield SUBGROUP_FEATURE_BALLOT = 0x8;
+
+  static bool hasExtension(const char* name);
+
+  // Whether compute shaders support all of the given subgroup features.
+  static bool computeSubgroupSupport(GLbitfield features);
 
 private:
   static void loadFileText(const std::string& filePath, std::vector<char>& text);
 
+  // Resolves includes, injects the definitions, lowers the GLSL version on OpenGL 4.5 and strips
+  // the bindless qualifiers for the classic path.
+  static void preprocessSource(const std::string& path, const Defines& defines, std::vector<char>& text);
+
+  static std::string resolveIncludes(const std::string& path, std::size_t sourceIndex, std::vector<std::string>& included);
+
   static void glDebugOutput(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
     const GLchar* message, const void* userParam);
 };
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstdint>
+
+namespace flut
+{
+  // Marching cubes lookup tables.
+  //
+  // Corner i of a cube sits at (i & 1, (i >> 1) & 1, (i >> 2) & 1). Edges are numbered along x
+  // first (corner pairs 0-1, 2-3, 4-5, 6-7), then y (0-2, 1-3, 4-6, 5-7), then z (0-4, 1-5, 2-6, 3-7).
+  // A corner is inside if its field value is at or above the iso value. Faces with two diagonal
+  // inside corners always separate them, which keeps neighboring cubes consistent (watertight).
+  // Triangles are wound counter-clockwise when seen from outside.
+  namespace MarchingCubes
+  {
+    constexpr std::uint32_t MAX_TRIANGLES = 5;
+
+    constexpr std::int32_t TRIANGLE_COUNTS[256] = {
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 2,
+      1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+      1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+      2, 3, 3, 2, 3, 4, 4, 3, 3, 4, 4, 3, 4, 5, 5, 2,
+      1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+      2, 3, 3, 4, 3, 2, 4, 3, 3, 4, 4, 5, 4, 3, 5, 2,
+      2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4,
+      3, 4, 4, 3, 4, 3, 5, 2, 4, 5, 5, 4, 5, 4, 2, 1,
+      1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+      2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4,
+      2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 2, 3, 4, 5, 3, 2,
+      3, 4, 4, 3, 4, 5, 5, 4, 4, 5, 3, 2, 5, 2, 4, 1,
+      2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 2, 3, 3, 2,
+      3, 4, 4, 5, 4, 3, 5, 4, 4, 5, 5, 2, 3, 2, 4, 1,
+      3, 4, 4, 5, 4, 5, 5, 2, 4, 5, 3, 4, 3, 4, 2, 1,
+      2, 3, 3, 2, 3, 2, 4, 1, 3, 4, 2, 1, 2, 1, 1, 0,
+    };
+
+    constexpr std::int32_t TRIANGLE_EDGES[256][16] = {
+      {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 5,  0,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  5,  4,  8,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  0,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  5,  1,  8,  9,  5, -1, -1, -1, -1, -1, -1, -1},
+      {11,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {11,  0,  9, 11,  1,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1,  4,  8, 11,  1,  8,  9, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 4, 11, 10,  4,  5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8, 11, 10,  8,  5, 11,  8,  0,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 4, 11, 10,  4,  9, 11,  4,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 8, 11, 10,  8,  9, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  5,  4,  6,  9,  5,  6,  2,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8,  4,  1, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  0,  1,  6,  2,  0, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8,  4,  1, 10,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  5,  1,  6,  9,  5,  6,  2,  9, -1, -1, -1, -1},
+      { 6,  2,  8, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  2,  0, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8, 11,  0,  9, 11,  1,  0, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1,  4,  6, 11,  1,  6,  9, 11,  6,  2,  9, -1, -1, -1, -1},
+      { 6,  2,  8,  4, 11, 10,  4,  5, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6, 11, 10,  6,  5, 11,  6,  0,  5,  6,  2,  0, -1, -1, -1, -1},
+      { 6,  2,  8,  4, 11, 10,  4,  9, 11,  4,  0,  9, -1, -1, -1, -1},
+      { 6, 11, 10,  6,  9, 11,  6,  2,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 9,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 5,  2,  7,  5,  0,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  5,  4,  8,  7,  5,  8,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  0,  1,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10,  5,  2,  7,  5,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  5,  1,  8,  7,  5,  8,  2,  7, -1, -1, -1, -1},
+      {11,  1,  5,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4, 11,  1,  5,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      {11,  2,  7, 11,  0,  2, 11,  1,  0, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1,  4,  8, 11,  1,  8,  7, 11,  8,  2,  7, -1, -1, -1, -1},
+      { 4, 11, 10,  4,  5, 11,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 8, 11, 10,  8,  5, 11,  8,  0,  5,  9,  2,  7, -1, -1, -1, -1},
+      { 4, 11, 10,  4,  7, 11,  4,  2,  7,  4,  0,  2, -1, -1, -1, -1},
+      { 8, 11, 10,  8,  7, 11,  8,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  7,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  9,  0,  6,  7,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  8,  6,  5,  0,  6,  7,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  5,  4,  6,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  7,  9,  4,  1, 10, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  0,  1,  6,  9,  0,  6,  7,  9, -1, -1, -1, -1},
+      { 6,  0,  8,  6,  5,  0,  6,  7,  5,  4,  1, 10, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  5,  1,  6,  7,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  7,  9, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  9,  0,  6,  7,  9, 11,  1,  5, -1, -1, -1, -1},
+      { 6,  0,  8,  6,  1,  0,  6, 11,  1,  6,  7, 11, -1, -1, -1, -1},
+      { 6,  1,  4,  6, 11,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  7,  9,  4, 11, 10,  4,  5, 11, -1, -1, -1, -1},
+      { 6, 11, 10,  6,  5, 11,  6,  0,  5,  6,  9,  0,  6,  7,  9, -1},
+      { 6,  0,  8,  6,  4,  0,  6, 10,  4,  6, 11, 10,  6,  7, 11, -1},
+      { 6, 11, 10,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  0,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  5,  4,  8,  9,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  3,  6,  4,  1,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3,  6,  8,  1,  3,  8,  0,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  3,  6,  4,  1,  3,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3,  6,  8,  1,  3,  8,  5,  1,  8,  9,  5, -1, -1, -1, -1},
+      {10,  3,  6, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  0,  4, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6, 11,  0,  9, 11,  1,  0, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  1,  4,  8, 11,  1,  8,  9, 11, -1, -1, -1, -1},
+      { 4,  3,  6,  4, 11,  3,  4,  5, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3,  6,  8, 11,  3,  8,  5, 11,  8,  0,  5, -1, -1, -1, -1},
+      { 4,  3,  6,  4, 11,  3,  4,  9, 11,  4,  0,  9, -1, -1, -1, -1},
+      { 8,  3,  6,  8, 11,  3,  8,  9, 11, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  8, 10,  3,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  2,  0, 10,  3,  2, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  8, 10,  3,  2,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      {10,  5,  4, 10,  9,  5, 10,  2,  9, 10,  3,  2, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  3,  2,  4,  1,  3, -1, -1, -1, -1, -1, -1, -1},
+      { 0,  3,  2,  0,  1,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  3,  2,  4,  1,  3,  5,  0,  9, -1, -1, -1, -1},
+      { 5,  2,  9,  5,  3,  2,  5,  1,  3, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  8, 10,  3,  2, 11,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  2,  0, 10,  3,  2, 11,  1,  5, -1, -1, -1, -1},
+      {10,  2,  8, 10,  3,  2, 11,  0,  9, 11,  1,  0, -1, -1, -1, -1},
+      {10,  1,  4, 10, 11,  1, 10,  9, 11, 10,  2,  9, 10,  3,  2, -1},
+      { 4,  2,  8,  4,  3,  2,  4, 11,  3,  4,  5, 11, -1, -1, -1, -1},
+      {11,  0,  5, 11,  2,  0, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  3,  2,  4, 11,  3,  4,  9, 11,  4,  0,  9, -1},
+      {11,  2,  9, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  0,  4,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  5,  2,  7,  5,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  5,  4,  8,  7,  5,  8,  2,  7, -1, -1, -1, -1},
+      { 4,  3,  6,  4,  1,  3,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3,  6,  8,  1,  3,  8,  0,  1,  9,  2,  7, -1, -1, -1, -1},
+      { 4,  3,  6,  4,  1,  3,  5,  2,  7,  5,  0,  2, -1, -1, -1, -1},
+      { 8,  3,  6,  8,  1,  3,  8,  5,  1,  8,  7,  5,  8,  2,  7, -1},
+      {10,  3,  6, 11,  1,  5,  9,  2,  7, -1, -1, -1, -1, -1, -1, -1},
+      {10,  3,  6,  8,  0,  4, 11,  1,  5,  9,  2,  7, -1, -1, -1, -1},
+      {10,  3,  6, 11,  2,  7, 11,  0,  2, 11,  1,  0, -1, -1, -1, -1},
+      {10,  3,  6,  8,  1,  4,  8, 11,  1,  8,  7, 11,  8,  2,  7, -1},
+      { 4,  3,  6,  4, 11,  3,  4,  5, 11,  9,  2,  7, -1, -1, -1, -1},
+      { 8,  3,  6,  8, 11,  3,  8,  5, 11,  8,  0,  5,  9,  2,  7, -1},
+      { 4,  3,  6,  4, 11,  3,  4,  7, 11,  4,  2,  7,  4,  0,  2, -1},
+      { 8,  3,  6,  8, 11,  3,  8,  7, 11,  8,  2,  7, -1, -1, -1, -1},
+      {10,  9,  8, 10,  7,  9, 10,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  9,  0, 10,  7,  9, 10,  3,  7, -1, -1, -1, -1},
+      {10,  0,  8, 10,  5,  0, 10,  7,  5, 10,  3,  7, -1, -1, -1, -1},
+      {10,  5,  4, 10,  7,  5, 10,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  9,  8,  4,  7,  9,  4,  3,  7,  4,  1,  3, -1, -1, -1, -1},
+      { 9,  3,  7,  9,  1,  3,  9,  0,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  0,  8,  4,  5,  0,  4,  7,  5,  4,  3,  7,  4,  1,  3, -1},
+      { 5,  3,  7,  5,  1,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  9,  8, 10,  7,  9, 10,  3,  7, 11,  1,  5, -1, -1, -1, -1},
+      {10,  0,  4, 10,  9,  0, 10,  7,  9, 10,  3,  7, 11,  1,  5, -1},
+      {10,  0,  8, 10,  1,  0, 10, 11,  1, 10,  7, 11, 10,  3,  7, -1},
+      {10,  1,  4, 10, 11,  1, 10,  7, 11, 10,  3,  7, -1, -1, -1, -1},
+      { 4,  9,  8,  4,  7,  9,  4,  3,  7,  4, 11,  3,  4,  5, 11, -1},
+      {11,  0,  5, 11,  9,  0, 11,  7,  9, 11,  3,  7, -1, -1, -1, -1},
+      { 4,  0,  8, 11,  3,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {11,  3,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 7,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 5,  0,  9,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  5,  4,  8,  9,  5,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  0,  1,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  1, 10,  5,  0,  9,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  5,  1,  8,  9,  5,  7,  3, 11, -1, -1, -1, -1},
+      { 7,  1,  5,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4,  7,  1,  5,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 7,  0,  9,  7,  1,  0,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1,  4,  8,  3,  1,  8,  7,  3,  8,  9,  7, -1, -1, -1, -1},
+      { 4,  3, 10,  4,  7,  3,  4,  5,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3, 10,  8,  7,  3,  8,  5,  7,  8,  0,  5, -1, -1, -1, -1},
+      { 4,  3, 10,  4,  7,  3,  4,  9,  7,  4,  0,  9, -1, -1, -1, -1},
+      { 8,  3, 10,  8,  7,  3,  8,  9,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  2,  0,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  2,  8,  5,  0,  9,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  5,  4,  6,  9,  5,  6,  2,  9,  7,  3, 11, -1, -1, -1, -1},
+      { 6,  2,  8,  4,  1, 10,  7,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  0,  1,  6,  2,  0,  7,  3, 11, -1, -1, -1, -1},
+      { 6,  2,  8,  4,  1, 10,  5,  0,  9,  7,  3, 11, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  5,  1,  6,  9,  5,  6,  2,  9,  7,  3, 11, -1},
+      { 6,  2,  8,  7,  1,  5,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  2,  0,  7,  1,  5,  7,  3,  1, -1, -1, -1, -1},
+      { 6,  2,  8,  7,  0,  9,  7,  1,  0,  7,  3,  1, -1, -1, -1, -1},
+      { 6,  1,  4,  6,  3,  1,  6,  7,  3,  6,  9,  7,  6,  2,  9, -1},
+      { 6,  2,  8,  4,  3, 10,  4,  7,  3,  4,  5,  7, -1, -1, -1, -1},
+      { 6,  3, 10,  6,  7,  3,  6,  5,  7,  6,  0,  5,  6,  2,  0, -1},
+      { 6,  2,  8,  4,  3, 10,  4,  7,  3,  4,  9,  7,  4,  0,  9, -1},
+      { 6,  3, 10,  6,  7,  3,  6,  9,  7,  6,  2,  9, -1, -1, -1, -1},
+      { 9,  3, 11,  9,  2,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4,  9,  3, 11,  9,  2,  3, -1, -1, -1, -1, -1, -1, -1},
+      { 5,  3, 11,  5,  2,  3,  5,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  5,  4,  8, 11,  5,  8,  3, 11,  8,  2,  3, -1, -1, -1, -1},
+      { 4,  1, 10,  9,  3, 11,  9,  2,  3, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  0,  1,  9,  3, 11,  9,  2,  3, -1, -1, -1, -1},
+      { 4,  1, 10,  5,  3, 11,  5,  2,  3,  5,  0,  2, -1, -1, -1, -1},
+      { 8,  1, 10,  8,  5,  1,  8, 11,  5,  8,  3, 11,  8,  2,  3, -1},
+      { 9,  1,  5,  9,  3,  1,  9,  2,  3, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  0,  4,  9,  1,  5,  9,  3,  1,  9,  2,  3, -1, -1, -1, -1},
+      { 2,  1,  0,  2,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  1,  4,  8,  3,  1,  8,  2,  3, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  3, 10,  4,  2,  3,  4,  9,  2,  4,  5,  9, -1, -1, -1, -1},
+      { 8,  3, 10,  8,  2,  3,  8,  9,  2,  8,  5,  9,  8,  0,  5, -1},
+      { 4,  3, 10,  4,  2,  3,  4,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  3, 10,  8,  2,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6, 11,  9,  6,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  9,  0,  6, 11,  9,  6,  3, 11, -1, -1, -1, -1},
+      { 6,  0,  8,  6,  5,  0,  6, 11,  5,  6,  3, 11, -1, -1, -1, -1},
+      { 6,  5,  4,  6, 11,  5,  6,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6, 11,  9,  6,  3, 11,  4,  1, 10, -1, -1, -1, -1},
+      { 6,  1, 10,  6,  0,  1,  6,  9,  0,  6, 11,  9,  6,  3, 11, -1},
+      { 6,  0,  8,  6,  5,  0,  6, 11,  5,  6,  3, 11,  4,  1, 10, -1},
+      { 6,  1, 10,  6,  5,  1,  6, 11,  5,  6,  3, 11, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  5,  9,  6,  1,  5,  6,  3,  1, -1, -1, -1, -1},
+      { 6,  0,  4,  6,  9,  0,  6,  5,  9,  6,  1,  5,  6,  3,  1, -1},
+      { 6,  0,  8,  6,  1,  0,  6,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  1,  4,  6,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  9,  8,  6,  5,  9,  6,  4,  5,  6, 10,  4,  6,  3, 10, -1},
+      { 6,  3, 10,  9,  0,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 6,  0,  8,  6,  4,  0,  6, 10,  4,  6,  3, 10, -1, -1, -1, -1},
+      { 6,  3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  7,  6, 10, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  7,  6, 10, 11,  7,  8,  0,  4, -1, -1, -1, -1, -1, -1, -1},
+      {10,  7,  6, 10, 11,  7,  5,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      {10,  7,  6, 10, 11,  7,  8,  5,  4,  8,  9,  5, -1, -1, -1, -1},
+      { 4,  7,  6,  4, 11,  7,  4,  1, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  7,  6,  8, 11,  7,  8,  1, 11,  8,  0,  1, -1, -1, -1, -1},
+      { 4,  7,  6,  4, 11,  7,  4,  1, 11,  5,  0,  9, -1, -1, -1, -1},
+      { 8,  7,  6,  8, 11,  7,  8,  1, 11,  8,  5,  1,  8,  9,  5, -1},
+      {10,  7,  6, 10,  5,  7, 10,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      {10,  7,  6, 10,  5,  7, 10,  1,  5,  8,  0,  4, -1, -1, -1, -1},
+      {10,  7,  6, 10,  9,  7, 10,  0,  9, 10,  1,  0, -1, -1, -1, -1},
+      {10,  7,  6, 10,  9,  7, 10,  8,  9, 10,  4,  8, 10,  1,  4, -1},
+      { 4,  7,  6,  4,  5,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  7,  6,  8,  5,  7,  8,  0,  5, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  7,  6,  4,  9,  7,  4,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  7,  6,  8,  9,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  8, 10,  7,  2, 10, 11,  7, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  2,  0, 10,  7,  2, 10, 11,  7, -1, -1, -1, -1},
+      {10,  2,  8, 10,  7,  2, 10, 11,  7,  5,  0,  9, -1, -1, -1, -1},
+      {10,  5,  4, 10,  9,  5, 10,  2,  9, 10,  7,  2, 10, 11,  7, -1},
+      { 4,  2,  8,  4,  7,  2,  4, 11,  7,  4,  1, 11, -1, -1, -1, -1},
+      { 7,  1, 11,  7,  0,  1,  7,  2,  0, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  7,  2,  4, 11,  7,  4,  1, 11,  5,  0,  9, -1},
+      { 5,  2,  9,  5,  7,  2,  5, 11,  7,  5,  1, 11, -1, -1, -1, -1},
+      {10,  2,  8, 10,  7,  2, 10,  5,  7, 10,  1,  5, -1, -1, -1, -1},
+      {10,  0,  4, 10,  2,  0, 10,  7,  2, 10,  5,  7, 10,  1,  5, -1},
+      {10,  2,  8, 10,  7,  2, 10,  9,  7, 10,  0,  9, 10,  1,  0, -1},
+      {10,  1,  4,  7,  2,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  7,  2,  4,  5,  7, -1, -1, -1, -1, -1, -1, -1},
+      { 7,  0,  5,  7,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  2,  8,  4,  7,  2,  4,  9,  7,  4,  0,  9, -1, -1, -1, -1},
+      { 7,  2,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  6, 10,  9,  2, 10, 11,  9, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  6, 10,  9,  2, 10, 11,  9,  8,  0,  4, -1, -1, -1, -1},
+      {10,  2,  6, 10,  0,  2, 10,  5,  0, 10, 11,  5, -1, -1, -1, -1},
+      {10,  2,  6, 10,  8,  2, 10,  4,  8, 10,  5,  4, 10, 11,  5, -1},
+      { 4,  2,  6,  4,  9,  2,  4, 11,  9,  4,  1, 11, -1, -1, -1, -1},
+      { 8,  2,  6,  8,  9,  2,  8, 11,  9,  8,  1, 11,  8,  0,  1, -1},
+      { 4,  2,  6,  4,  0,  2,  4,  5,  0,  4, 11,  5,  4,  1, 11, -1},
+      { 8,  2,  6,  5,  1, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  6, 10,  9,  2, 10,  5,  9, 10,  1,  5, -1, -1, -1, -1},
+      {10,  2,  6, 10,  9,  2, 10,  5,  9, 10,  1,  5,  8,  0,  4, -1},
+      {10,  2,  6, 10,  0,  2, 10,  1,  0, -1, -1, -1, -1, -1, -1, -1},
+      {10,  2,  6, 10,  8,  2, 10,  4,  8, 10,  1,  4, -1, -1, -1, -1},
+      { 4,  2,  6,  4,  9,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  2,  6,  8,  9,  2,  8,  5,  9,  8,  0,  5, -1, -1, -1, -1},
+      { 4,  2,  6,  4,  0,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 8,  2,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  9,  8, 10, 11,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  9,  0, 10, 11,  9, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  8, 10,  5,  0, 10, 11,  5, -1, -1, -1, -1, -1, -1, -1},
+      {10,  5,  4, 10, 11,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  9,  8,  4, 11,  9,  4,  1, 11, -1, -1, -1, -1, -1, -1, -1},
+      { 9,  1, 11,  9,  0,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  0,  8,  4,  5,  0,  4, 11,  5,  4,  1, 11, -1, -1, -1, -1},
+      { 5,  1, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  9,  8, 10,  5,  9, 10,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+      {10,  0,  4, 10,  9,  0, 10,  5,  9, 10,  1,  5, -1, -1, -1, -1},
+      {10,  0,  8, 10,  1,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {10,  1,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  9,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 9,  0,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      { 4,  0,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+      {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    };
+  }
+}
@@ -0,0 +1,57 @@
+#include "Obj.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+void flut::Obj::loadTriangles(const std::string& path, std::vector<glm::vec3>& triangleVertices)
+{
+  std::ifstream file{ path };
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open file: " + path);
+  }
+
+  std::vector<glm::vec3> positions;
+  std::vector<std::uint32_t> face;
+  std::string line;
+
+  while (std::getline(file, line))
+  {
+    std::istringstream stream{ line };
+    std::string type;
+    stream >> type;
+
+    if (type == "v")
+    {
+      glm::vec3 position;
+      stream >> position.x >> position.y >> position.z;
+      positions.push_back(position);
+    }
+    else if (type == "f")
+    {
+      // Face vertices look like "v", "v/vt", "v//vn" or "v/vt/vn"; negative indices are relative.
+      face.clear();
+      std::string vertex;
+
+      while (stream >> vertex)
+      {
+        const long index = std::stol(vertex.substr(0, vertex.find('/')));
+        const long resolved = (index < 0) ? static_cast<long>(positions.size()) + index : index - 1;
+
+        if (resolved < 0 || resolved >= static_cast<long>(positions.size())) {
+          throw std::runtime_error("Invalid face index in file: " + path);
+        }
+
+        face.push_back(static_cast<std::uint32_t>(resolved));
+      }
+
+      for (std::size_t i = 2; i < face.size(); ++i)
+      {
+        triangleVertices.push_back(positions[face[0]]);
+        triangleVertices.push_back(positions[face[i - 1]]);
+        triangleVertices.push_back(positions[face[i]]);
+      }
+    }
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace flut
+{
+  // Minimal Wavefront OBJ reader for static geometry.
+  namespace Obj
+  {
+    // Appends three vertices per triangle. Polygons are triangulated as fans,
+    // everything except vertex positions and faces is ignored.
+    void loadTriangles(const std::string& path, std::vector<glm::vec3>& triangleVertices);
+  }
+}
@@ -0,0 +1,167 @@
+#include "RenderGraph.hpp"
+
+#include <string>
+
+using namespace flut;
+
+namespace
+{
+  // Buffer and texture names are separate namespaces.
+  std::uint64_t bufferKey(GLuint buffer)
+  {
+    return buffer;
+  }
+
+  std::uint64_t textureKey(GLuint texture)
+  {
+    return (std::uint64_t(1) << 32) | texture;
+  }
+}
+
+RenderGraph::Pass& RenderGraph::Pass::storageRead(GLuint buffer)
+{
+  return access(bufferKey(buffer), GL_SHADER_STORAGE_BARRIER_BIT, false, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::storageWrite(GLuint buffer)
+{
+  return access(bufferKey(buffer), GL_SHADER_STORAGE_BARRIER_BIT, true, true);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::imageRead(GLuint texture)
+{
+  return access(textureKey(texture), GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, false, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::imageWrite(GLuint texture)
+{
+  return access(textureKey(texture), GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, true, true);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::textureRead(GLuint texture)
+{
+  return access(textureKey(texture), GL_TEXTURE_FETCH_BARRIER_BIT, false, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::framebufferWrite(GLuint texture)
+{
+  return access(textureKey(texture), GL_FRAMEBUFFER_BARRIER_BIT, true, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::vertexRead(GLuint buffer)
+{
+  return access(bufferKey(buffer), GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, false, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::indirectRead(GLuint buffer)
+{
+  return access(bufferKey(buffer), GL_COMMAND_BARRIER_BIT, false, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::bufferUpdate(GLuint buffer)
+{
+  return access(bufferKey(buffer), GL_BUFFER_UPDATE_BARRIER_BIT, true, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::textureUpdate(GLuint texture)
+{
+  return access(textureKey(texture), GL_TEXTURE_UPDATE_BARRIER_BIT, true, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::access(std::uint64_t resource, GLbitfield bits, bool write, bool incoherent)
+{
+  accesses_.push_back(Access{resource, bits, write, incoherent});
+  return *this;
+}
+
+void RenderGraph::Pass::submit()
+{
+#ifndef NDEBUG
+  graph_->validate(*this);
+#endif
+
+  // Any access to a resource with pending shader writes has to wait for them, including writes
+  // (their order is undefined otherwise).
+  GLbitfield barrier = 0;
+  for (const Access& access : accesses_)
+  {
+    barrier |= graph_->resource(access.resource).pending & access.bits;
+  }
+
+  if (barrier != 0)
+  {
+    glMemoryBarrier(barrier);
+    ++graph_->barrierCount_;
+
+    for (Resource& resource : graph_->resources_)
+    {
+      resource.pending &= ~barrier;
+    }
+  }
+
+  for (const Access& access : accesses_)
+  {
+    if (access.incoherent)
+    {
+      graph_->resource(access.resource).pending = GL_ALL_BARRIER_BITS;
+    }
+  }
+
+  accesses_.clear();
+}
+
+RenderGraph::Pass& RenderGraph::pass(const char* name)
+{
+  pass_.graph_ = this;
+  pass_.name_ = name;
+  pass_.accesses_.clear();
+  return pass_;
+}
+
+std::uint32_t RenderGraph::takeBarrierCount()
+{
+  const std::uint32_t count = barrierCount_;
+  barrierCount_ = 0;
+  return count;
+}
+
+RenderGraph::Resource& RenderGraph::resource(std::uint64_t resource)
+{
+  for (Resource& entry : resources_)
+  {
+    if (entry.resource == resource)
+    {
+      return entry;
+    }
+  }
+
+  resources_.push_back(Resource{resource, 0});
+  return resources_.back();
+}
+
+void RenderGraph::validate(const Pass& pass) const
+{
+  // A barrier only orders separate passes. A pass that writes a resource and accesses it in
+  // another way (e.g. samples a texture it writes as an image) has a hazard no barrier can fix.
+  for (const Pass::Access& write : pass.accesses_)
+  {
+    if (!write.write)
+    {
+      continue;
+    }
+
+    for (const Pass::Access& other : pass.accesses_)
+    {
+      if (other.resource != write.resource || other.bits == write.bits)
+      {
+        continue;
+      }
+
+      const std::string message = std::string("Render graph: pass \"") + pass.name_ +
+                                  "\" writes a resource it also accesses in another way.";
+      glDebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR, 0,
+                           GL_DEBUG_SEVERITY_MEDIUM, -1, message.c_str());
+      return;
+    }
+  }
+}
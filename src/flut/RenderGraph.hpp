@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+namespace flut
+{
+  // Derives the memory barriers between passes from the resources they declare. Shader writes to
+  // storage buffers and images are incoherent: a later pass that accesses the resource in any way
+  // needs a barrier for that kind of access. Barriers are issued lazily, right before the first
+  // pass that needs them, and only with the bits of the accesses that depend on pending writes.
+  // Passes run in submission order, each one is submitted right before its commands are issued.
+  class RenderGraph
+  {
+  public:
+    class Pass
+    {
+    public:
+      // Shader storage buffer access.
+      Pass& storageRead(GLuint buffer);
+      Pass& storageWrite(GLuint buffer);
+
+      // Image load/store and atomics.
+      Pass& imageRead(GLuint texture);
+      Pass& imageWrite(GLuint texture);
+
+      // Sampling in any shader stage.
+      Pass& textureRead(GLuint texture);
+
+      // Rendering into a framebuffer attachment.
+      Pass& framebufferWrite(GLuint texture);
+
+      // Vertex attributes sourced from a buffer.
+      Pass& vertexRead(GLuint buffer);
+
+      // Indirect dispatch and draw arguments.
+      Pass& indirectRead(GLuint buffer);
+
+      // Buffer and texture commands (clears, uploads, copies and readbacks).
+      Pass& bufferUpdate(GLuint buffer);
+      Pass& textureUpdate(GLuint texture);
+
+      // Issues the barrier the declared accesses need, then marks the shader writes as pending.
+      void submit();
+
+    private:
+      friend class RenderGraph;
+
+      struct Access
+      {
+        std::uint64_t resource;
+        GLbitfield bits;
+        bool write;
+        bool incoherent;
+      };
+
+      Pass& access(std::uint64_t resource, GLbitfield bits, bool write, bool incoherent);
+
+      RenderGraph* graph_ = nullptr;
+      const char* name_ = nullptr;
+      std::vector<Access> accesses_;
+    };
+
+  public:
+    // Starts the declaration of the next pass. The name is only used for hazard reports.
+    Pass& pass(const char* name);
+
+    // Barriers issued since the last call.
+    std::uint32_t takeBarrierCount();
+
+  private:
+    struct Resource
+    {
+      std::uint64_t resource;
+      GLbitfield pending;
+    };
+
+    Resource& resource(std::uint64_t resource);
+
+    void validate(const Pass& pass) const;
+
+  private:
+    Pass pass_;
+    std::vector<Resource> resources_;
+    std::uint32_t barrierCount_ = 0;
+  };
+}
@@ -0,0 +1,175 @@
+#include "RenderTargetPool.hpp"
+#include "GlHelper.hpp"
+
+#include <algorithm>
+
+using namespace flut;
+
+RenderTargetPool::RenderTargetPool(std::uint32_t granularity)
+  : granularity_(std::max(granularity, 1u))
+  , width_{0}
+  , height_{0}
+  , frame_{0}
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+  for (Entry& entry : entries_)
+  {
+    destroy(entry);
+  }
+}
+
+RenderTargetPool::Target RenderTargetPool::acquire(GLenum format, std::uint32_t width, std::uint32_t height, bool imageAccess)
+{
+  width_ = std::max(width_, (width + granularity_ - 1) / granularity_ * granularity_);
+  height_ = std::max(height_, (height + granularity_ - 1) / granularity_ * granularity_);
+
+  Entry* match = nullptr;
+
+  for (Entry& entry : entries_)
+  {
+    if (!entry.used && entry.format == format && entry.imageAccess == imageAccess)
+    {
+      match = &entry;
+      break;
+    }
+  }
+
+  if (!match)
+  {
+    entries_.push_back(Entry{Target{}, format, imageAccess, 0, 0, false, 0});
+    match = &entries_.back();
+  }
+
+  // Targets left behind by a smaller extent are reallocated, so all targets of a frame match.
+  if (match->width != width_ || match->height != height_)
+  {
+    destroy(*match);
+    match->width = width_;
+    match->height = height_;
+    create(*match);
+  }
+
+  match->used = true;
+  match->lastFrame = frame_;
+  return match->target;
+}
+
+void RenderTargetPool::release(const Target& target)
+{
+  for (Entry& entry : entries_)
+  {
+    if (entry.target.texture == target.texture)
+    {
+      entry.used = false;
+    }
+  }
+}
+
+void RenderTargetPool::nextFrame(std::uint32_t maxUnusedFrames)
+{
+  ++frame_;
+
+  for (Entry& entry : entries_)
+  {
+    entry.used = false;
+
+    if (frame_ - entry.lastFrame > maxUnusedFrames)
+    {
+      destroy(entry);
+    }
+  }
+
+  entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                [](const Entry& entry) { return entry.target.texture == 0; }),
+                 entries_.end());
+}
+
+std::uint32_t RenderTargetPool::width() const
+{
+  return width_;
+}
+
+std::uint32_t RenderTargetPool::height() const
+{
+  return height_;
+}
+
+std::uint64_t RenderTargetPool::memoryBytes() const
+{
+  std::uint64_t bytes = 0;
+
+  for (const Entry& entry : entries_)
+  {
+    bytes += sizeBytes(entry);
+  }
+
+  return bytes;
+}
+
+std::uint64_t RenderTargetPool::frameMemoryBytes() const
+{
+  std::uint64_t bytes = 0;
+
+  for (const Entry& entry : entries_)
+  {
+    if (entry.lastFrame == frame_)
+    {
+      bytes += sizeBytes(entry);
+    }
+  }
+
+  return bytes;
+}
+
+void RenderTargetPool::create(Entry& entry)
+{
+  Target& target = entry.target;
+  glCreateTextures(GL_TEXTURE_2D, 1, &target.texture);
+  glTextureStorage2D(target.texture, 1, entry.format, entry.width, entry.height);
+  glTextureParameteri(target.texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(target.texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  target.handle = GlHelper::createTextureHandle(target.texture);
+
+  if (entry.imageAccess)
+  {
+    target.imageHandle = GlHelper::createImageHandle(target.texture, GL_FALSE, entry.format, GL_WRITE_ONLY);
+  }
+}
+
+void RenderTargetPool::destroy(Entry& entry)
+{
+  Target& target = entry.target;
+
+  if (target.texture == 0)
+  {
+    return;
+  }
+
+  if (target.imageHandle != 0)
+  {
+    GlHelper::deleteImageHandle(target.imageHandle);
+  }
+
+  GlHelper::deleteTextureHandle(target.handle);
+  glDeleteTextures(1, &target.texture);
+  target = Target{};
+}
+
+std::uint64_t RenderTargetPool::sizeBytes(const Entry& entry)
+{
+  // 24 bit depth and RGB8 are padded to 32 bit.
+  std::uint64_t texelBytes = 4;
+
+  switch (entry.format)
+  {
+  case GL_RGB32F: texelBytes = 12; break;
+  case GL_RGBA32F: texelBytes = 16; break;
+  case GL_R16F: case GL_R16: texelBytes = 2; break;
+  default: break;
+  }
+
+  return std::uint64_t(entry.width) * entry.height * texelBytes;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+namespace flut
+{
+  // Grow-only pool of 2D render targets with texture handles (see GlHelper). All targets share one
+  // extent, the largest size requested so far rounded up to the granularity, so a window resize
+  // within the extent only changes the viewport and UV scale of the passes. Targets are handed
+  // out per frame, a released target is reused by the next request for the same format.
+  class RenderTargetPool
+  {
+  public:
+    struct Target
+    {
+      GLuint texture = 0;
+      GLuint64 handle = 0;
+      GLuint64 imageHandle = 0;
+    };
+
+  public:
+    explicit RenderTargetPool(std::uint32_t granularity);
+
+    ~RenderTargetPool();
+
+  public:
+    // Returns an unused target of the format that covers width x height, growing the extent if
+    // needed. The image handle is only created (write only) if image access is requested.
+    Target acquire(GLenum format, std::uint32_t width, std::uint32_t height, bool imageAccess = false);
+
+    void release(const Target& target);
+
+    // Releases all targets and frees the ones that were not acquired for the given number of frames.
+    void nextFrame(std::uint32_t maxUnusedFrames);
+
+    std::uint32_t width() const;
+
+    std::uint32_t height() const;
+
+    // Memory of all pooled targets, and of the targets acquired in the current frame.
+    std::uint64_t memoryBytes() const;
+
+    std::uint64_t frameMemoryBytes() const;
+
+  private:
+    struct Entry
+    {
+      Target target;
+      GLenum format;
+      bool imageAccess;
+      std::uint32_t width;
+      std::uint32_t height;
+      bool used;
+      std::uint64_t lastFrame;
+    };
+
+    void create(Entry& entry);
+
+    void destroy(Entry& entry);
+
+    static std::uint64_t sizeBytes(const Entry& entry);
+
+  private:
+    std::uint32_t granularity_;
+    std::uint32_t width_;
+    std::uint32_t height_;
+    std::uint64_t frame_;
+    std::vector<Entry> entries_;
+  };
+}
@@ -1,14 +1,49 @@
 #include "Simulation.hpp"
 #include "GlHelper.hpp"
+#include "MarchingCubes.hpp"
+#include "Obj.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <string>
 
 using namespace flut;
 
+namespace
+{
+  // GLSL literals of constants compiled into the shaders, exact for 32 bit floats.
+  std::string glslFloat(float value)
+  {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+
+    if (literal.find_first_of(".e") == std::string::npos)
+    {
+      literal += ".0";
+    }
+
+    return (value < 0.0f) ? "(" + literal + ")" : literal;
+  }
+
+  std::string glslVec3(const glm::vec3& value)
+  {
+    return "vec3(" + glslFloat(value.x) + ", " + glslFloat(value.y) + ", " + glslFloat(value.z) + ")";
+  }
+
+  std::string glslIvec3(const glm::ivec3& value)
+  {
+    return "ivec3(" + std::to_string(value.x) + ", " + std::to_string(value.y) + ", " + std::to_string(value.z) + ")";
+  }
+}
+
 struct Particle
 {
   float position_x;
@@ -21,37 +56,198 @@ struct Particle
   float pressure;
 };
 
+// Render target formats, indexed by SimulationOptions::colorFormat and smoothingFormat.
+// The smoothing format index doubles as the depth encoding of the smoothing shaders.
+const GLenum COLOR_FORMATS[] = { GL_RGB32F, GL_RGBA8, GL_R11F_G11F_B10F };
+const GLenum SMOOTHING_FORMATS[] = { GL_R32F, GL_R16F, GL_R16 };
+constexpr std::int32_t DEPTH_ENCODING_WINDOW = 0;
+constexpr std::int32_t DEPTH_ENCODING_COMPLEMENTARY = 1;
+constexpr std::int32_t DEPTH_ENCODING_LINEAR = 2;
+
 Simulation::Simulation(std::uint32_t width, std::uint32_t height)
+  : Simulation(width, height, WorkGroupSizes{})
+{
+}
+
+Simulation::Simulation(std::uint32_t width, std::uint32_t height, const WorkGroupSizes& workGroups)
   : width_(width)
   , height_(height)
   , newWidth_(width)
   , newHeight_(height)
   , swapFrame_{false}
+  , swapQueries_{false}
   , frame_{0}
+  , workGroups_(workGroups)
   , integrationsPerFrame_{1}
+  , stepCount_{0}
+  , accumulator_{0.0f}
+  , adaptiveDt_{0.0f}
+  , sleepingActive_{false}
+  , binsValid_{false}
+  , lastStepSorted_{true}
+  , stepsSinceSort_{0}
+  , fullStepMs_{0.0f}
+  , incrementalStepMs_{0.0f}
+  , emitAccumulator_{0.0f}
+  , renderTargets_{RENDER_TARGET_GRANULARITY}
+  , texSmoothedDepth_{0}
 {
+  stats_.renderWidth = width;
+  stats_.renderHeight = height;
+
 #ifndef NDEBUG
   GlHelper::enableDebugHooks();
 #endif
 
-  // Shaders
-  programSimStep1_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep1.comp");
-  programSimStep2_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep2.comp");
-  programSimStep3_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep3.comp");
-  programSimStep4_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep4.comp");
-  programSimStep5_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep5.comp");
-  programSimStep6_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep6.comp");
-
-  programRenderGeometry_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderGeometry.vert", RESOURCES_DIR "/renderGeometry.frag");
-  programRenderFlat_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderGeometry.vert", RESOURCES_DIR "/renderFlat.frag");
-  programRenderCurvature_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderBoundingBox.vert", RESOURCES_DIR "/renderCurvature.frag");
-  programRenderShading_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderBoundingBox.vert", RESOURCES_DIR "/renderShading.frag");
-
   // Precalc weight functions
   weightConstViscosity_ = static_cast<float>(45.0f / (M_PI * std::pow(KERNEL_RADIUS, 6)));
   weightConstPressure_ = static_cast<float>(45.0f / (M_PI * std::pow(KERNEL_RADIUS, 6)));
   weightConstKernel_ = static_cast<float>(315.0f / (64.0f * M_PI * std::pow(KERNEL_RADIUS, 9)));
 
+  // Shaders. Bricks are the blocks of the grid covered by one work group of steps 2 and 4.
+  const glm::ivec3 brickRes = (GRID_RES + workGroups_.grid - 1) / workGroups_.grid;
+  const GlHelper::Defines groupDefines = {
+    { "PARTICLE_GROUP_SIZE", std::to_string(workGroups_.particle) },
+    { "GRID_GROUP_SIZE_X", std::to_string(workGroups_.grid.x) },
+    { "GRID_GROUP_SIZE_Y", std::to_string(workGroups_.grid.y) },
+    { "GRID_GROUP_SIZE_Z", std::to_string(workGroups_.grid.z) },
+    { "BRICK_RES", glslIvec3(brickRes) }
+  };
+
+  // Steps 1 to 3 have a variant that aggregates the grid atomics per subgroup.
+  GlHelper::Defines binningDefines = groupDefines;
+  binningDefines.push_back({ "GRID_RES", glslIvec3(GRID_RES) });
+  binningDefines.push_back({ "SUBGROUP_ATOMICS", "0" });
+  programSimStep1_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep1.comp", binningDefines);
+  programSimStep2_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep2.comp", binningDefines);
+  programSimStep3_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep3.comp", binningDefines);
+
+  stats_.subgroupAtomicsSupported = GlHelper::computeSubgroupSupport(
+    GlHelper::SUBGROUP_FEATURE_BASIC | GlHelper::SUBGROUP_FEATURE_ARITHMETIC | GlHelper::SUBGROUP_FEATURE_BALLOT);
+  programSimStep1Subgroup_ = 0;
+  programSimStep2Subgroup_ = 0;
+  programSimStep3Subgroup_ = 0;
+  if (stats_.subgroupAtomicsSupported)
+  {
+    binningDefines.back().second = "1";
+    programSimStep1Subgroup_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep1.comp", binningDefines);
+    programSimStep2Subgroup_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep2.comp", binningDefines);
+    programSimStep3Subgroup_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep3.comp", binningDefines);
+  }
+
+  GlHelper::Defines gridDefines = groupDefines;
+  gridDefines.push_back({ "GRID_RES", glslIvec3(GRID_RES) });
+  programSimStep4_ = GlHelper::createComputeShader(RESOURCES_DIR "/simStep4.comp", gridDefines);
+
+  // Radix sort path of steps 2 and 3. The keys are cell indices, the marker of particles
+  // removed by the sink (all bits set) has to stay above all of them in the sorted bits.
+  programRadixHistogram_ = GlHelper::createComputeShader(RESOURCES_DIR "/radixHistogram.comp", gridDefines);
+  programRadixScan_ = GlHelper::createComputeShader(RESOURCES_DIR "/radixScan.comp", gridDefines);
+  programRadixScatter_ = GlHelper::createComputeShader(RESOURCES_DIR "/radixScatter.comp", gridDefines);
+  programRadixRanges_ = GlHelper::createComputeShader(RESOURCES_DIR "/radixRanges.comp", gridDefines);
+  std::uint32_t keyBits = 0;
+  while ((GRID_VOXEL_COUNT >> keyBits) != 0)
+  {
+    ++keyBits;
+  }
+  radixPasses_ = (keyBits + RADIX_BITS - 1) / RADIX_BITS;
+
+  // Steps 5 and 6 have the SPH constants compiled in. Sleeping and the row-merged neighbor ranges
+  // are permutations, indexed by sleeping + 2 * row ranges.
+  GlHelper::Defines sphDefines = groupDefines;
+  sphDefines.insert(sphDefines.end(), {
+    { "GRID_SIZE", glslVec3(GRID_SIZE) },
+    { "GRID_ORIGIN", glslVec3(GRID_ORIGIN) },
+    { "GRID_RES", glslIvec3(GRID_RES) },
+    { "MASS", glslFloat(MASS) },
+    { "KERNEL_RADIUS", glslFloat(KERNEL_RADIUS) },
+    { "WEIGHT_CONST_KERNEL", glslFloat(weightConstKernel_) },
+    { "WEIGHT_CONST_PRESSURE", glslFloat(weightConstPressure_) },
+    { "WEIGHT_CONST_VISCOSITY", glslFloat(weightConstViscosity_) },
+    { "STIFFNESS", glslFloat(STIFFNESS) },
+    { "REST_DENSITY", glslFloat(REST_DENSITY) },
+    { "REST_PRESSURE", glslFloat(REST_PRESSURE) },
+    { "VIS_COEFF", glslFloat(VIS_COEFF) },
+    { "SLEEP_DENSITY_CHANGE", glslFloat(SLEEP_DENSITY_CHANGE) },
+    { "SLEEPING", "0" },
+    { "ROW_RANGES", "0" }
+  });
+  for (std::size_t variant = 0; variant < programsSimStep5_.size(); ++variant)
+  {
+    sphDefines[sphDefines.size() - 2].second = (variant & 1) ? "1" : "0";
+    sphDefines.back().second = (variant & 2) ? "1" : "0";
+    programsSimStep5_[variant] = GlHelper::createComputeShader(RESOURCES_DIR "/simStep5.comp", sphDefines);
+    programsSimStep6_[variant] = GlHelper::createComputeShader(RESOURCES_DIR "/simStep6.comp", sphDefines);
+  }
+
+  programPcisphInit_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphInit.comp", groupDefines);
+  programPcisphPredict_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphPredict.comp", groupDefines);
+  programPcisphDensity_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphDensity.comp", groupDefines);
+  programPcisphCheck_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphCheck.comp");
+  programPcisphPressure_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphPressure.comp", groupDefines);
+  programPcisphApply_ = GlHelper::createComputeShader(RESOURCES_DIR "/pcisphApply.comp", groupDefines);
+
+  programPbfInit_ = GlHelper::createComputeShader(RESOURCES_DIR "/pbfInit.comp", groupDefines);
+  programPbfLambda_ = GlHelper::createComputeShader(RESOURCES_DIR "/pbfLambda.comp", groupDefines);
+  programPbfDelta_ = GlHelper::createComputeShader(RESOURCES_DIR "/pbfDelta.comp", groupDefines);
+  programPbfVelocity_ = GlHelper::createComputeShader(RESOURCES_DIR "/pbfVelocity.comp", groupDefines);
+  programPbfViscosity_ = GlHelper::createComputeShader(RESOURCES_DIR "/pbfViscosity.comp", groupDefines);
+
+  programSimTimestep_ = GlHelper::createComputeShader(RESOURCES_DIR "/simTimestep.comp", groupDefines);
+  programSimTimestepUpdate_ = GlHelper::createComputeShader(RESOURCES_DIR "/simTimestepUpdate.comp");
+  programSimSleep_ = GlHelper::createComputeShader(RESOURCES_DIR "/simSleep.comp");
+  programSimEmit_ = GlHelper::createComputeShader(RESOURCES_DIR "/simEmit.comp", groupDefines);
+  programSimLiveCount_ = GlHelper::createComputeShader(RESOURCES_DIR "/simLiveCount.comp", groupDefines);
+  programSimInit_ = GlHelper::createComputeShader(RESOURCES_DIR "/simInit.comp", groupDefines);
+
+  // Point rendering variants are compiled on first use.
+  programsRenderGeometry_.fill(0);
+  programRenderCurvature_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderBoundingBox.vert", RESOURCES_DIR "/renderCurvature.frag");
+  programRenderShading_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderBoundingBox.vert", RESOURCES_DIR "/renderShading.frag");
+  const GlHelper::Defines smoothDefines = {
+    { "TILE_SIZE", std::to_string(SMOOTH_TILE_SIZE) },
+    { "MAX_ITERATIONS", std::to_string(SMOOTH_ITERATIONS_PER_DISPATCH) }
+  };
+  programRenderCurvatureTiled_ = GlHelper::createComputeShader(RESOURCES_DIR "/renderCurvature.comp", smoothDefines);
+  programRenderBilateral_ = GlHelper::createComputeShader(RESOURCES_DIR "/renderBilateral.comp", smoothDefines);
+  programRenderMesh_ = GlHelper::createVertFragShader(RESOURCES_DIR "/renderMesh.vert", RESOURCES_DIR "/renderMesh.frag");
+
+  programMeshDensity_ = GlHelper::createComputeShader(RESOURCES_DIR "/meshDensity.comp");
+  programMeshClassify_ = GlHelper::createComputeShader(RESOURCES_DIR "/meshClassify.comp");
+  programMeshArgs_ = GlHelper::createComputeShader(RESOURCES_DIR "/meshArgs.comp");
+  programMeshGenerate_ = GlHelper::createComputeShader(RESOURCES_DIR "/meshGenerate.comp");
+
+  // PCISPH and PBF: rest density and pressure scaling (Solenthaler and Pajarola 2009) from a particle
+  // with a full neighborhood on a cubic lattice, spaced like the initial fluid block.
+  const float latticeSpacing = std::cbrt(GRID_SIZE.x * GRID_SIZE.y * GRID_SIZE.z * 0.125f / PARTICLE_COUNT);
+  const std::int32_t latticeExtent = static_cast<std::int32_t>(std::ceil(KERNEL_RADIUS / latticeSpacing));
+  glm::vec3 gradientSum{0.0f};
+  float gradientDotSum = 0.0f;
+  latticeRestDensity_ = 0.0f;
+  for (std::int32_t x = -latticeExtent; x <= latticeExtent; ++x)
+  {
+    for (std::int32_t y = -latticeExtent; y <= latticeExtent; ++y)
+    {
+      for (std::int32_t z = -latticeExtent; z <= latticeExtent; ++z)
+      {
+        const glm::vec3 r = glm::vec3(x, y, z) * latticeSpacing;
+        const float rLen = glm::length(r);
+        if (rLen >= KERNEL_RADIUS)
+        {
+          continue;
+        }
+        latticeRestDensity_ += MASS * weightConstKernel_ * std::pow(KERNEL_RADIUS * KERNEL_RADIUS - rLen * rLen, 3.0f);
+        if (rLen > 0.0f)
+        {
+          const glm::vec3 gradient = -weightConstPressure_ * (KERNEL_RADIUS - rLen) * (KERNEL_RADIUS - rLen) * (r / rLen);
+          gradientSum += gradient;
+          gradientDotSum += glm::dot(gradient, gradient);
+        }
+      }
+    }
+  }
+  pcisphGradientSum_ = glm::dot(gradientSum, gradientSum) + gradientDotSum;
+
   // Bounding box
   const std::vector<glm::vec3> bboxVertices{
     GRID_ORIGIN + glm::vec3{       0.0f,        0.0f, GRID_SIZE.z},
@@ -90,47 +286,206 @@ Simulation::Simulation(std::uint32_t width, std::uint32_t height)
   // Uniform grid
   glCreateTextures(GL_TEXTURE_3D, 1, &texGrid_);
   glTextureStorage3D(texGrid_, 1, GL_R32UI, GRID_RES.x, GRID_RES.y, GRID_RES.z);
-  texGridImgHandle_ = glGetImageHandleARB(texGrid_, 0, GL_FALSE, 0, GL_R32UI);
-  glMakeImageHandleResidentARB(texGridImgHandle_, GL_READ_WRITE);
+  texGridImgHandle_ = GlHelper::createImageHandle(texGrid_, GL_TRUE, GL_R32UI, GL_READ_WRITE);
 
   glCreateBuffers(1, &bufCounters_);
-  glNamedBufferStorage(bufCounters_, 4, nullptr, GL_DYNAMIC_STORAGE_BIT);
+  glNamedBufferStorage(bufCounters_, 3 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  // Occupancy masks of the cells (shifted by one bit, plus a word of padding) and the bricks.
+  // Velocities of all bricks count as written at first, step 4 zeroes the empty ones once.
+  const std::uint32_t brickCount = brickRes.x * brickRes.y * brickRes.z;
+  glCreateBuffers(1, &bufOccupancy_);
+  glNamedBufferStorage(bufOccupancy_, ((GRID_VOXEL_COUNT + 1) / 32 + 2) * sizeof(std::uint32_t), nullptr, 0);
+  glCreateBuffers(1, &bufBrickOccupancy_);
+  glNamedBufferStorage(bufBrickOccupancy_, ((brickCount + 31) / 32) * sizeof(std::uint32_t), nullptr, 0);
+  glCreateBuffers(1, &bufVelocityBricks_);
+  glNamedBufferStorage(bufVelocityBricks_, brickCount * sizeof(std::uint32_t), nullptr, 0);
+  const std::uint32_t brickWritten = 1;
+  glClearNamedBufferData(bufVelocityBricks_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &brickWritten);
+
+  // PCISPH and PBF side buffers and solver state (converged flag, iteration, density errors, totals
+  // and the PCISPH iteration dispatch arguments).
+  glCreateBuffers(1, &bufPredictedPositions_);
+  glNamedBufferStorage(bufPredictedPositions_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+  glCreateBuffers(1, &bufAccelNonPressure_);
+  glNamedBufferStorage(bufAccelNonPressure_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+  glCreateBuffers(1, &bufAccelPressure_);
+  glNamedBufferStorage(bufAccelPressure_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+  glCreateBuffers(1, &bufPbfPositions1_);
+  glNamedBufferStorage(bufPbfPositions1_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+  glCreateBuffers(1, &bufPbfPositions2_);
+  glNamedBufferStorage(bufPbfPositions2_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+  glCreateBuffers(1, &bufSolverState_);
+  glNamedBufferStorage(bufSolverState_, 8 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  glCreateBuffers(1, &bufSolverReadback_);
+  glNamedBufferStorage(bufSolverReadback_, 2 * 8 * sizeof(std::uint32_t), nullptr, 0);
+  solverFences_[0] = nullptr;
+  solverFences_[1] = nullptr;
+
+  // Timestep read by steps 1 and 6, with the maxima and history of the adaptive timestep.
+  std::vector<std::uint32_t> timestepState(TIMESTEP_BUFFER_SIZE / sizeof(std::uint32_t), 0);
+  const float initialDt = fixedTimestep();
+  std::memcpy(&timestepState[0], &initialDt, sizeof(initialDt));
+  glCreateBuffers(1, &bufTimestep_);
+  glNamedBufferStorage(bufTimestep_, TIMESTEP_BUFFER_SIZE, timestepState.data(), GL_DYNAMIC_STORAGE_BIT);
+  glCreateBuffers(1, &bufTimestepReadback_);
+  glNamedBufferStorage(bufTimestepReadback_, 2 * TIMESTEP_BUFFER_SIZE, nullptr, 0);
+  glCreateBuffers(1, &bufAccelerations_);
+  glNamedBufferStorage(bufAccelerations_, PARTICLE_COUNT * sizeof(float), nullptr, 0);
+  timestepFences_[0] = nullptr;
+  timestepFences_[1] = nullptr;
 
   // Velocity texture
   glCreateTextures(GL_TEXTURE_3D, 1, &texVelocity_);
   glTextureStorage3D(texVelocity_, 1, GL_RGBA32F, GRID_RES.x, GRID_RES.y, GRID_RES.z);
-  texVelocityHandle_ = glGetTextureHandleARB(texVelocity_);
-  glMakeTextureHandleResidentARB(texVelocityHandle_);
-  texVelocityImgHandle_ = glGetImageHandleARB(texVelocity_, 0, GL_FALSE, 0, GL_RGBA32F);
-  glMakeImageHandleResidentARB(texVelocityImgHandle_, GL_READ_WRITE);
-
   glTextureParameteri(texVelocity_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTextureParameteri(texVelocity_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  texVelocityHandle_ = GlHelper::createTextureHandle(texVelocity_);
+  texVelocityImgHandle_ = GlHelper::createImageHandle(texVelocity_, GL_TRUE, GL_RGBA32F, GL_READ_WRITE);
+
+  // Sleeping: per cell motion flags and quiet step counters, the compacted list of awake cells
+  // (at most one per particle) and its indirect dispatch arguments.
+  glCreateTextures(GL_TEXTURE_3D, 1, &texCellMotion_);
+  glTextureStorage3D(texCellMotion_, 1, GL_R32UI, GRID_RES.x, GRID_RES.y, GRID_RES.z);
+  texCellMotionImgHandle_ = GlHelper::createImageHandle(texCellMotion_, GL_TRUE, GL_R32UI, GL_READ_WRITE);
+  glCreateTextures(GL_TEXTURE_3D, 1, &texCellQuietSteps_);
+  glTextureStorage3D(texCellQuietSteps_, 1, GL_R32UI, GRID_RES.x, GRID_RES.y, GRID_RES.z);
+  texCellQuietStepsImgHandle_ = GlHelper::createImageHandle(texCellQuietSteps_, GL_TRUE, GL_R32UI, GL_READ_WRITE);
+  glCreateBuffers(1, &bufActiveCells_);
+  glNamedBufferStorage(bufActiveCells_, PARTICLE_COUNT * sizeof(std::uint32_t), nullptr, 0);
+  glCreateBuffers(1, &bufSleepArgs_);
+  glNamedBufferStorage(bufSleepArgs_, 3 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  // Linear cell index of every particle, written by step 1 in the unsorted order and carried
+  // into the sorted order by step 3.
+  glCreateBuffers(1, &bufCellKeys_);
+  glNamedBufferStorage(bufCellKeys_, PARTICLE_COUNT * sizeof(std::uint32_t), nullptr, 0);
+  glCreateBuffers(1, &bufSortedCellKeys_);
+  glNamedBufferStorage(bufSortedCellKeys_, PARTICLE_COUNT * sizeof(std::uint32_t), nullptr, 0);
+
+  // Radix sort: ping-pong keys and particle indices, and the digit counts of every tile.
+  glCreateBuffers(2, bufRadixKeys_);
+  glCreateBuffers(2, bufRadixValues_);
+  for (std::uint32_t i = 0; i < 2; ++i)
+  {
+    glNamedBufferStorage(bufRadixKeys_[i], PARTICLE_COUNT * sizeof(std::uint32_t), nullptr, 0);
+    glNamedBufferStorage(bufRadixValues_[i], PARTICLE_COUNT * sizeof(std::uint32_t), nullptr, 0);
+  }
+  const std::uint32_t radixTiles = (PARTICLE_COUNT + workGroups_.particle - 1) / workGroups_.particle;
+  glCreateBuffers(1, &bufRadixHistogram_);
+  glNamedBufferStorage(bufRadixHistogram_, (1 << RADIX_BITS) * radixTiles * sizeof(std::uint32_t), nullptr, 0);
+
+  // Live particle count followed by the indirect dispatch arguments of the particle passes and
+  // the indirect draw arguments (set by reset()). Emitters append behind the live particles, sinks
+  // drop particles in the sort, so the buffers only ever hold live particles at the front.
+  glCreateBuffers(1, &bufLiveCount_);
+  glNamedBufferStorage(bufLiveCount_, 8 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  glCreateBuffers(1, &bufLiveCountReadback_);
+  glNamedBufferStorage(bufLiveCountReadback_, 2 * 3 * sizeof(std::uint32_t), nullptr, 0);
+  liveCountFences_[0] = nullptr;
+  liveCountFences_[1] = nullptr;
+
+  // Surface mesh: density field, active voxel list, lookup tables and the generated vertices.
+  glCreateTextures(GL_TEXTURE_3D, 1, &texMeshField_);
+  glTextureStorage3D(texMeshField_, 1, GL_R32F, MESH_FIELD_RES.x, MESH_FIELD_RES.y, MESH_FIELD_RES.z);
+  glTextureParameteri(texMeshField_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(texMeshField_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(texMeshField_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texMeshField_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texMeshField_, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  texMeshFieldHandle_ = GlHelper::createTextureHandle(texMeshField_);
+  texMeshFieldImgHandle_ = GlHelper::createImageHandle(texMeshField_, GL_TRUE, GL_R32F, GL_WRITE_ONLY);
+
+  glCreateBuffers(1, &bufMeshCounters_);
+  glNamedBufferStorage(bufMeshCounters_, 8 * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  const std::uint32_t meshVoxelCount = (MESH_FIELD_RES.x - 1) * (MESH_FIELD_RES.y - 1) * (MESH_FIELD_RES.z - 1);
+  glCreateBuffers(1, &bufMeshActiveVoxels_);
+  glNamedBufferStorage(bufMeshActiveVoxels_, meshVoxelCount * 2 * sizeof(std::uint32_t), nullptr, 0);
+
+  glCreateBuffers(1, &bufMeshTables_);
+  glNamedBufferStorage(bufMeshTables_, sizeof(MarchingCubes::TRIANGLE_COUNTS) + sizeof(MarchingCubes::TRIANGLE_EDGES), nullptr, GL_DYNAMIC_STORAGE_BIT);
+  glNamedBufferSubData(bufMeshTables_, 0, sizeof(MarchingCubes::TRIANGLE_COUNTS), MarchingCubes::TRIANGLE_COUNTS);
+  glNamedBufferSubData(bufMeshTables_, sizeof(MarchingCubes::TRIANGLE_COUNTS), sizeof(MarchingCubes::TRIANGLE_EDGES), MarchingCubes::TRIANGLE_EDGES);
 
-  // Initial particles
-  std::vector<Particle> particles;
-  particles.resize(PARTICLE_COUNT);
-  for (std::uint32_t i = 0; i < PARTICLE_COUNT; ++i)
-  {
-    Particle& p = particles[i];
-    const float x = ((std::rand() % 10000) / 10000.0f) * (GRID_SIZE.x * 0.5);
-    const float y = ((std::rand() % 10000) / 10000.0f) * (GRID_SIZE.y * 0.5);
-    const float z = ((std::rand() % 10000) / 10000.0f) * (GRID_SIZE.z * 0.5);
-    p.position_x = GRID_ORIGIN.x + GRID_SIZE.x * 0.25f + x;
-    p.position_y = GRID_ORIGIN.y + GRID_SIZE.y * 0.25f + y;
-    p.position_z = GRID_ORIGIN.z + GRID_SIZE.z * 0.25f + z;
-    p.density = 0.0f;
-    p.velocity_x = 0.0f;
-    p.velocity_y = 0.0f;
-    p.velocity_z = 0.0f;
-    p.pressure = 0.0f;
+  glCreateBuffers(1, &bufMeshVertices_);
+  glNamedBufferStorage(bufMeshVertices_, MESH_MAX_VERTICES * 2 * sizeof(glm::vec4), nullptr, 0);
+
+  glCreateVertexArrays(1, &vao4_);
+  glEnableVertexArrayAttrib(vao4_, 0);
+  glVertexArrayVertexBuffer(vao4_, 0, bufMeshVertices_, 0, 2 * sizeof(glm::vec4));
+  glVertexArrayAttribBinding(vao4_, 0, 0);
+  glVertexArrayAttribFormat(vao4_, 0, 4, GL_FLOAT, GL_FALSE, 0);
+  glEnableVertexArrayAttrib(vao4_, 1);
+  glVertexArrayAttribBinding(vao4_, 1, 0);
+  glVertexArrayAttribFormat(vao4_, 1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4));
+
+  // Static obstacle: triangles with face normals, in the same layout as the surface mesh.
+  std::vector<glm::vec3> obstacleTriangles;
+  Obj::loadTriangles(RESOURCES_DIR "/obstacle.obj", obstacleTriangles);
+
+  std::vector<glm::vec4> obstacleVertices;
+  obstacleVertices.reserve(obstacleTriangles.size() * 2);
+  for (std::size_t i = 0; i < obstacleTriangles.size(); i += 3)
+  {
+    const glm::vec3& a = obstacleTriangles[i + 0];
+    const glm::vec3& b = obstacleTriangles[i + 1];
+    const glm::vec3& c = obstacleTriangles[i + 2];
+    const glm::vec4 normal{ glm::normalize(glm::cross(b - a, c - a)), 0.0f };
+    obstacleVertices.insert(obstacleVertices.end(), { glm::vec4(a, 1.0f), normal, glm::vec4(b, 1.0f), normal, glm::vec4(c, 1.0f), normal });
   }
+  obstacleVertexCount_ = static_cast<std::uint32_t>(obstacleTriangles.size());
+  obstacleVertices.resize(std::max<std::size_t>(obstacleVertices.size(), 2));
+
+  glCreateBuffers(1, &bufObstacleVertices_);
+  glNamedBufferStorage(bufObstacleVertices_, obstacleVertices.size() * sizeof(glm::vec4), obstacleVertices.data(), 0);
+
+  glCreateVertexArrays(1, &vao5_);
+  glEnableVertexArrayAttrib(vao5_, 0);
+  glVertexArrayVertexBuffer(vao5_, 0, bufObstacleVertices_, 0, 2 * sizeof(glm::vec4));
+  glVertexArrayAttribBinding(vao5_, 0, 0);
+  glVertexArrayAttribFormat(vao5_, 0, 4, GL_FLOAT, GL_FALSE, 0);
+  glEnableVertexArrayAttrib(vao5_, 1);
+  glVertexArrayAttribBinding(vao5_, 1, 0);
+  glVertexArrayAttribFormat(vao5_, 1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4));
+
+  // Obstacle SDF (outward normal + signed distance) over the whole domain, generated once on the GPU.
+  glCreateTextures(GL_TEXTURE_3D, 1, &texObstacleSdf_);
+  glTextureStorage3D(texObstacleSdf_, 1, GL_RGBA16F, SDF_RES.x, SDF_RES.y, SDF_RES.z);
+  glTextureParameteri(texObstacleSdf_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(texObstacleSdf_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(texObstacleSdf_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texObstacleSdf_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texObstacleSdf_, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+  const GLuint programObstacleSdf = GlHelper::createComputeShader(RESOURCES_DIR "/obstacleSdf.comp");
+  const GLuint64 texObstacleSdfImgHandle = GlHelper::createImageHandle(texObstacleSdf_, GL_TRUE, GL_RGBA16F, GL_WRITE_ONLY);
+  glUseProgram(programObstacleSdf);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufObstacleVertices_);
+  GlHelper::setImageUniform(programObstacleSdf, 0, texObstacleSdfImgHandle);
+  glProgramUniform3iv(programObstacleSdf, 1, 1, glm::value_ptr(SDF_RES));
+  glProgramUniform3fv(programObstacleSdf, 2, 1, glm::value_ptr(GRID_ORIGIN));
+  glProgramUniform3fv(programObstacleSdf, 3, 1, glm::value_ptr(GRID_SIZE));
+  glProgramUniform1ui(programObstacleSdf, 4, obstacleVertexCount_ / 3);
+  glDispatchCompute((SDF_RES.x + 4 - 1) / 4, (SDF_RES.y + 4 - 1) / 4, (SDF_RES.z + 4 - 1) / 4);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  GlHelper::deleteImageHandle(texObstacleSdfImgHandle);
+  glDeleteProgram(programObstacleSdf);
+
+  texObstacleSdfHandle_ = GlHelper::createTextureHandle(texObstacleSdf_);
+
+  // Particles, filled on the GPU by reset().
   const auto size = PARTICLE_COUNT * sizeof(Particle);
   glCreateBuffers(1, &bufParticles1_);
   glCreateBuffers(1, &bufParticles2_);
-  glNamedBufferStorage(bufParticles1_, size, particles.data(), 0);
-  glNamedBufferStorage(bufParticles2_, size, particles.data(), 0);
+  glNamedBufferStorage(bufParticles1_, size, nullptr, 0);
+  glNamedBufferStorage(bufParticles2_, size, nullptr, 0);
+
+  // Positions before the last integration, in the same order as the particles that are rendered.
+  glCreateBuffers(1, &bufPrevPositions_);
+  glNamedBufferStorage(bufPrevPositions_, PARTICLE_COUNT * sizeof(glm::vec4), nullptr, 0);
+
+  reset();
 
   glCreateVertexArrays(1, &vao1_);
   glEnableVertexArrayAttrib(vao1_, 0);
@@ -145,8 +500,8 @@ Simulation::Simulation(std::uint32_t width, std::uint32_t height)
   glVertexArrayAttribFormat(vao2_, 0, 3, GL_FLOAT, GL_FALSE, 0);
 
   // Timer queries
-  glCreateQueries(GL_TIME_ELAPSED, 7, &timerQueries_[0][0]);
-  glCreateQueries(GL_TIME_ELAPSED, 7, &timerQueries_[1][0]);
+  glCreateQueries(GL_TIME_ELAPSED, TIMER_QUERY_COUNT, &timerQueries_[0][0]);
+  glCreateQueries(GL_TIME_ELAPSED, TIMER_QUERY_COUNT, &timerQueries_[1][0]);
   glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
   // Default state
@@ -154,116 +509,162 @@ Simulation::Simulation(std::uint32_t width, std::uint32_t height)
   glEnable(GL_DEPTH_TEST);
   glDepthMask(GL_TRUE);
 
-  // Textures and buffers
-  createFrameObjects();
-}
-
-void flut::Simulation::createFrameObjects()
-{
-  glCreateTextures(GL_TEXTURE_2D, 1, &texDepth_);
-  glTextureStorage2D(texDepth_, 1, GL_DEPTH_COMPONENT24, width_, height_);
-  glTextureParameteri(texDepth_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTextureParameteri(texDepth_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  texDepthHandle_ = glGetTextureHandleARB(texDepth_);
-  glMakeTextureHandleResidentARB(texDepthHandle_);
-
-  glCreateTextures(GL_TEXTURE_2D, 1, &texColor_);
-  glTextureStorage2D(texColor_, 1, GL_RGB32F, width_, height_);
-  glTextureParameteri(texColor_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTextureParameteri(texColor_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  texColorHandle_ = glGetTextureHandleARB(texColor_);
-  glMakeTextureHandleResidentARB(texColorHandle_);
-
-  glCreateTextures(GL_TEXTURE_2D, 1, &texTemp1_);
-  glTextureStorage2D(texTemp1_, 1, GL_R32F, width_, height_);
-  glTextureParameteri(texTemp1_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTextureParameteri(texTemp1_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  texTemp1Handle_ = glGetTextureHandleARB(texTemp1_);
-  glMakeTextureHandleResidentARB(texTemp1Handle_);
-
-  glCreateTextures(GL_TEXTURE_2D, 1, &texTemp2_);
-  glTextureStorage2D(texTemp2_, 1, GL_R32F, width_, height_);
-  glTextureParameteri(texTemp2_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTextureParameteri(texTemp2_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  texTemp2Handle_ = glGetTextureHandleARB(texTemp2_);
-  glMakeTextureHandleResidentARB(texTemp2Handle_);
-
+  // Frame buffers, the render targets come from the pool every frame.
   glCreateFramebuffers(1, &fbo1_);
-  glNamedFramebufferTexture(fbo1_, GL_DEPTH_ATTACHMENT, texDepth_, 0);
-  glNamedFramebufferTexture(fbo1_, GL_COLOR_ATTACHMENT0, texColor_, 0);
-
   glCreateFramebuffers(1, &fbo2_);
-  glNamedFramebufferTexture(fbo2_, GL_COLOR_ATTACHMENT0, texTemp1_, 0);
-
   glCreateFramebuffers(1, &fbo3_);
-  glNamedFramebufferTexture(fbo3_, GL_COLOR_ATTACHMENT0, texTemp2_, 0);
 }
 
-void flut::Simulation::deleteFrameObjects()
+Simulation::~Simulation()
 {
   glDeleteFramebuffers(1, &fbo1_);
   glDeleteFramebuffers(1, &fbo2_);
   glDeleteFramebuffers(1, &fbo3_);
-
-  glMakeTextureHandleNonResidentARB(texDepthHandle_);
-  glDeleteTextures(1, &texDepth_);
-
-  glMakeTextureHandleNonResidentARB(texColorHandle_);
-  glDeleteTextures(1, &texColor_);
-
-  glMakeTextureHandleNonResidentARB(texTemp1Handle_);
-  glDeleteTextures(1, &texTemp1_);
-
-  glMakeTextureHandleNonResidentARB(texTemp2Handle_);
-  glDeleteTextures(1, &texTemp2_);
-}
-
-Simulation::~Simulation()
-{
-  deleteFrameObjects();
   glDeleteProgram(programSimStep1_);
   glDeleteProgram(programSimStep2_);
   glDeleteProgram(programSimStep3_);
-  glDeleteProgram(programSimStep5_);
-  glDeleteProgram(programSimStep6_);
-  glDeleteProgram(programRenderFlat_);
-  glDeleteProgram(programRenderGeometry_);
+  glDeleteProgram(programSimStep1Subgroup_);
+  glDeleteProgram(programSimStep2Subgroup_);
+  glDeleteProgram(programSimStep3Subgroup_);
+  glDeleteProgram(programRadixHistogram_);
+  glDeleteProgram(programRadixScan_);
+  glDeleteProgram(programRadixScatter_);
+  glDeleteProgram(programRadixRanges_);
+  for (std::size_t variant = 0; variant < programsSimStep5_.size(); ++variant)
+  {
+    glDeleteProgram(programsSimStep5_[variant]);
+    glDeleteProgram(programsSimStep6_[variant]);
+  }
+  glDeleteProgram(programPcisphInit_);
+  glDeleteProgram(programPcisphPredict_);
+  glDeleteProgram(programPcisphDensity_);
+  glDeleteProgram(programPcisphCheck_);
+  glDeleteProgram(programPcisphPressure_);
+  glDeleteProgram(programPcisphApply_);
+  glDeleteProgram(programPbfInit_);
+  glDeleteProgram(programPbfLambda_);
+  glDeleteProgram(programPbfDelta_);
+  glDeleteProgram(programPbfVelocity_);
+  glDeleteProgram(programPbfViscosity_);
+  glDeleteProgram(programSimTimestep_);
+  glDeleteProgram(programSimTimestepUpdate_);
+  glDeleteProgram(programSimSleep_);
+  glDeleteProgram(programSimEmit_);
+  glDeleteProgram(programSimLiveCount_);
+  glDeleteProgram(programSimInit_);
+  for (GLuint program : programsRenderGeometry_)
+  {
+    glDeleteProgram(program);
+  }
   glDeleteProgram(programRenderCurvature_);
   glDeleteProgram(programRenderShading_);
+  glDeleteProgram(programRenderCurvatureTiled_);
+  glDeleteProgram(programRenderBilateral_);
+  glDeleteProgram(programRenderMesh_);
+  glDeleteProgram(programMeshDensity_);
+  glDeleteProgram(programMeshClassify_);
+  glDeleteProgram(programMeshArgs_);
+  glDeleteProgram(programMeshGenerate_);
   glDeleteBuffers(1, &bufBBoxVertices_);
   glDeleteBuffers(1, &bufBBoxIndices_);
   glDeleteBuffers(1, &bufParticles1_);
   glDeleteBuffers(1, &bufParticles2_);
-  glMakeImageHandleNonResidentARB(texGridImgHandle_);
+  glDeleteBuffers(1, &bufPrevPositions_);
+  GlHelper::deleteImageHandle(texGridImgHandle_);
   glDeleteTextures(1, &texGrid_);
-  glMakeImageHandleNonResidentARB(texVelocityImgHandle_);
-  glMakeTextureHandleNonResidentARB(texVelocityHandle_);
+  GlHelper::deleteImageHandle(texVelocityImgHandle_);
+  GlHelper::deleteTextureHandle(texVelocityHandle_);
   glDeleteTextures(1, &texVelocity_);
+  GlHelper::deleteImageHandle(texCellMotionImgHandle_);
+  glDeleteTextures(1, &texCellMotion_);
+  GlHelper::deleteImageHandle(texCellQuietStepsImgHandle_);
+  glDeleteTextures(1, &texCellQuietSteps_);
+  glDeleteBuffers(1, &bufActiveCells_);
+  glDeleteBuffers(1, &bufCellKeys_);
+  glDeleteBuffers(1, &bufSortedCellKeys_);
+  glDeleteBuffers(2, bufRadixKeys_);
+  glDeleteBuffers(2, bufRadixValues_);
+  glDeleteBuffers(1, &bufRadixHistogram_);
+  glDeleteBuffers(1, &bufSleepArgs_);
+  glDeleteBuffers(1, &bufLiveCount_);
+  glDeleteBuffers(1, &bufLiveCountReadback_);
+  glDeleteSync(liveCountFences_[0]);
+  glDeleteSync(liveCountFences_[1]);
   glDeleteBuffers(1, &bufCounters_);
+  glDeleteBuffers(1, &bufOccupancy_);
+  glDeleteBuffers(1, &bufBrickOccupancy_);
+  glDeleteBuffers(1, &bufVelocityBricks_);
+  glDeleteBuffers(1, &bufPredictedPositions_);
+  glDeleteBuffers(1, &bufAccelNonPressure_);
+  glDeleteBuffers(1, &bufAccelPressure_);
+  glDeleteBuffers(1, &bufPbfPositions1_);
+  glDeleteBuffers(1, &bufPbfPositions2_);
+  glDeleteBuffers(1, &bufTimestep_);
+  glDeleteBuffers(1, &bufTimestepReadback_);
+  glDeleteBuffers(1, &bufAccelerations_);
+  glDeleteBuffers(1, &bufSolverState_);
+  glDeleteBuffers(1, &bufSolverReadback_);
+  glDeleteSync(solverFences_[0]);
+  glDeleteSync(solverFences_[1]);
+  glDeleteSync(timestepFences_[0]);
+  glDeleteSync(timestepFences_[1]);
+  GlHelper::deleteImageHandle(texMeshFieldImgHandle_);
+  GlHelper::deleteTextureHandle(texMeshFieldHandle_);
+  glDeleteTextures(1, &texMeshField_);
+  glDeleteBuffers(1, &bufMeshCounters_);
+  glDeleteBuffers(1, &bufMeshActiveVoxels_);
+  glDeleteBuffers(1, &bufMeshTables_);
+  glDeleteBuffers(1, &bufMeshVertices_);
+  glDeleteBuffers(1, &bufObstacleVertices_);
+  GlHelper::deleteTextureHandle(texObstacleSdfHandle_);
+  glDeleteTextures(1, &texObstacleSdf_);
   glDeleteVertexArrays(1, &vao1_);
   glDeleteVertexArrays(1, &vao2_);
   glDeleteVertexArrays(1, &vao3_);
-  glDeleteQueries(6, &timerQueries_[0][0]);
-  glDeleteQueries(6, &timerQueries_[1][0]);
+  glDeleteVertexArrays(1, &vao4_);
+  glDeleteVertexArrays(1, &vao5_);
+  glDeleteQueries(TIMER_QUERY_COUNT, &timerQueries_[0][0]);
+  glDeleteQueries(TIMER_QUERY_COUNT, &timerQueries_[1][0]);
 }
 
 void Simulation::render(const Camera& camera, float dt)
 {
   ++frame_;
 
-  GLuint* lastQuery = timerQueries_[swapFrame_ ? 0 : 1];
-  GLuint* query = timerQueries_[swapFrame_ ? 1 : 0];
+  GLuint* lastQuery = timerQueries_[swapQueries_ ? 0 : 1];
+  GLuint* query = timerQueries_[swapQueries_ ? 1 : 0];
 
-  // Resize window if needed.
-  if (width_ != newWidth_ || height_ != newHeight_)
-  {
-    width_ = newWidth_;
-    height_ = newHeight_;
-    deleteFrameObjects();
-    createFrameObjects();
-  }
+  // Render queries alternate per frame, independent of the number of integrations.
+  GLuint* lastRenderQuery = timerQueries_[(frame_ + 1) % 2];
+  GLuint* renderQuery = timerQueries_[frame_ % 2];
 
-  const glm::vec3 invCellSize = glm::vec3(GRID_RES) * (1.0f - 0.001f) / GRID_SIZE;
+  // Resizing the window or switching render target formats only changes the targets requested
+  // from the pool below. Targets of the last frame are handed back first.
+  width_ = newWidth_;
+  height_ = newHeight_;
+  options_.colorFormat = std::min(std::max(options_.colorFormat, 0), 2);
+  options_.smoothingFormat = std::min(std::max(options_.smoothingFormat, 0), 2);
+  frameColorFormat_ = options_.colorFormat;
+  frameSmoothingFormat_ = options_.smoothingFormat;
+  renderTargets_.nextFrame(RENDER_TARGET_UNUSED_FRAMES);
+  depthTarget_ = RenderTargetPool::Target{};
+  colorTarget_ = RenderTargetPool::Target{};
+  smoothTargets_[0] = RenderTargetPool::Target{};
+  smoothTargets_[1] = RenderTargetPool::Target{};
+
+  const glm::vec3 invCellSize = INV_CELL_SIZE;
+  const glm::vec3 gravity{options_.gravity[0], options_.gravity[1], options_.gravity[2]};
+  const glm::vec3 externalAcceleration = (options_.solverMode == 2) ? gravity : glm::vec3{0.0f};
+  const bool sleeping = options_.sleeping && options_.solverMode == 0;
+  // Only steps 5 and 6 widen their neighbor search by the drift of incremental steps.
+  const bool incrementalSort = options_.incrementalSort && options_.solverMode == 0;
+  const bool subgroupAtomics = options_.subgroupAtomics && stats_.subgroupAtomicsSupported;
+  const bool radixSort = options_.sortMode == 1;
+  // Only the radix sort keeps the cells of a row contiguous in the particle buffer.
+  const std::size_t neighborVariant = (sleeping ? 1 : 0) + ((options_.rowRanges && radixSort) ? 2 : 0);
+  const GLuint programStep1 = subgroupAtomics ? programSimStep1Subgroup_ : programSimStep1_;
+  const GLuint programStep2 = subgroupAtomics ? programSimStep2Subgroup_ : programSimStep2_;
+  const GLuint programStep3 = subgroupAtomics ? programSimStep3Subgroup_ : programSimStep3_;
 
   glViewport(0, 0, width_, height_);
 
@@ -273,222 +674,1067 @@ void Simulation::render(const Camera& camera, float dt)
   time_.simStep4Ms = 0.0f;
   time_.simStep5Ms = 0.0f;
   time_.simStep6Ms = 0.0f;
+  time_.renderGeometryMs = 0.0f;
+  time_.renderSmoothMs = 0.0f;
+  time_.renderShadingMs = 0.0f;
   time_.renderMs = 0.0f;
 
   if (frame_ > 1)
   {
     GLuint64 elapsedTime = 0;
-    glGetQueryObjectui64v(lastQuery[6], GL_QUERY_RESULT, &elapsedTime);
-    time_.renderMs = elapsedTime / 1000000.0f;
+    glGetQueryObjectui64v(lastRenderQuery[6], GL_QUERY_RESULT, &elapsedTime);
+    time_.renderGeometryMs = elapsedTime / 1000000.0f;
+    glGetQueryObjectui64v(lastRenderQuery[7], GL_QUERY_RESULT, &elapsedTime);
+    time_.renderSmoothMs = elapsedTime / 1000000.0f;
+    glGetQueryObjectui64v(lastRenderQuery[8], GL_QUERY_RESULT, &elapsedTime);
+    time_.renderShadingMs = elapsedTime / 1000000.0f;
+    time_.renderMs = time_.renderGeometryMs + time_.renderSmoothMs + time_.renderShadingMs;
+  }
+
+  updateRenderScale();
+  const std::uint32_t renderWidth = stats_.renderWidth;
+  const std::uint32_t renderHeight = stats_.renderHeight;
+
+  // The adaptive timestep stays on the GPU. The CPU only uses the last value read back to
+  // decide how many steps to run and to interpolate.
+  readTimestepStats();
+
+  // Fixed timestep: run as many integrations as the elapsed real time requires, but never more
+  // than the per-frame budget. Time that does not fit into the budget is dropped.
+  const float stepDt = timestep();
+  std::uint32_t substeps = 0;
+
+  if (stepDt > 0.0f)
+  {
+    accumulator_ += dt;
+    substeps = static_cast<std::uint32_t>(accumulator_ / stepDt);
+
+    if (substeps > integrationsPerFrame_)
+    {
+      substeps = integrationsPerFrame_;
+      accumulator_ = std::fmod(accumulator_, stepDt);
+    }
+    else
+    {
+      accumulator_ -= substeps * stepDt;
+    }
+  }
+
+  stats_.substeps = substeps;
+  if (dt > 0.0f)
+  {
+    const float speed = (substeps * stepDt) / dt;
+    stats_.simulationSpeed += (speed - stats_.simulationSpeed) * SIMULATION_SPEED_DAMPING;
+  }
+
+  readSolverStats();
+  readLiveCount();
+
+  // With a fixed timestep the CPU provides it, steps 1 and 6 always read it from the buffer.
+  if (!options_.adaptiveTimestep)
+  {
+    adaptiveDt_ = 0.0f;
+    stats_.timestep = stepDt;
+    graph_.pass("Timestep upload").bufferUpdate(bufTimestep_).submit();
+    glNamedBufferSubData(bufTimestep_, 0, sizeof(stepDt), &stepDt);
   }
 
-  for (std::uint32_t f = 0; f < integrationsPerFrame_; f++)
+  if (options_.solverMode != 0)
   {
-    if (frame_ > 1)
+    graph_.pass("Solver state clear").bufferUpdate(bufSolverState_).submit();
+    const std::uint32_t uiClearValue = 0;
+    glClearNamedBufferData(bufSolverState_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+  }
+
+  // Incremental sort: between full sorts, the particles stay in place and the grid keeps the
+  // cells they were binned in. A full sort runs every few steps, when particles are emitted, and
+  // when too many particles have left their bins or drifted too far (read back from an earlier
+  // frame). The neighbor search widens with the drift of the current step, so it never depends
+  // on the readback.
+  bool forceSort = !binsValid_ || stats_.staleParticleFraction > options_.resortThreshold ||
+                   stats_.maxCellDrift > MAX_CELL_DRIFT;
+  std::uint32_t fullSortSteps = 0;
+
+  for (std::uint32_t f = 0; f < substeps; f++)
+  {
+    if (stepCount_ > 0)
     {
+      // The whole step counts for the cost of incremental steps, their wider neighbor search
+      // in steps 5 and 6 offsets part of the saved sort.
       GLuint64 elapsedTime = 0;
+      float stepMs = 0.0f;
       glGetQueryObjectui64v(lastQuery[0], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep1Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
       glGetQueryObjectui64v(lastQuery[1], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep2Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
       glGetQueryObjectui64v(lastQuery[2], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep3Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
       glGetQueryObjectui64v(lastQuery[3], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep4Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
       glGetQueryObjectui64v(lastQuery[4], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep5Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
       glGetQueryObjectui64v(lastQuery[5], GL_QUERY_RESULT, &elapsedTime);
       time_.simStep6Ms += elapsedTime / 1000000.0f;
+      stepMs += elapsedTime / 1000000.0f;
+      float& costMs = lastStepSorted_ ? fullStepMs_ : incrementalStepMs_;
+      costMs = (costMs > 0.0f) ? glm::mix(costMs, stepMs, SORT_COST_DAMPING) : stepMs;
     }
 
-    // Step 1: Integrate position, do boundary handling.
-    //         Write particle count to voxel grid.
+    // The emitter keeps the volume flow (disc area times speed) at the lattice rest density.
+    std::uint32_t emitCount = 0;
+    if (options_.emitter)
+    {
+      const float emitRate = static_cast<float>(options_.emitterSpeed * M_PI * EMITTER_RADIUS * EMITTER_RADIUS * latticeRestDensity_ / MASS);
+      emitAccumulator_ += emitRate * stepDt;
+      emitCount = static_cast<std::uint32_t>(emitAccumulator_);
+      emitAccumulator_ -= static_cast<float>(emitCount);
+    }
+
+    // Emitted particles are not binned yet, they always need a full sort.
+    const bool fullSort = !incrementalSort || forceSort || emitCount > 0 ||
+                          stepsSinceSort_ + 1 >= static_cast<std::uint32_t>(std::max(options_.resortInterval, 1));
+
+    // Particles are integrated in place and then sorted into the other buffer. Incremental steps
+    // keep them in place.
+    const GLuint unsortedParticles = swapFrame_ ? bufParticles1_ : bufParticles2_;
+    const GLuint sortedParticles = !fullSort ? unsortedParticles : (swapFrame_ ? bufParticles2_ : bufParticles1_);
+
+    // Step 1: Emit new particles behind the live ones and update the live count.
+    //         Integrate position, do boundary handling. PBF applies gravity here and
+    //         bins the predicted positions.
+    //         Write particle count to voxel grid, except for particles inside the sink.
     glBeginQuery(GL_TIME_ELAPSED, query[0]);
-    const std::uint32_t fClearValue = 0;
-    glClearTexImage(texGrid_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &fClearValue);
-    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
-
-    glUseProgram(programSimStep1_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles1_ : bufParticles2_);
-    glProgramUniformHandleui64ARB(programSimStep1_, 0, texGridImgHandle_);
-    glProgramUniform3fv(programSimStep1_, 1, 1, glm::value_ptr(invCellSize));
-    glProgramUniform3fv(programSimStep1_, 2, 1, glm::value_ptr(GRID_ORIGIN));
-    glProgramUniform1ui(programSimStep1_, 3, PARTICLE_COUNT);
-    glProgramUniform3fv(programSimStep1_, 4, 1, glm::value_ptr(GRID_SIZE));
-    glProgramUniform1f(programSimStep1_, 5, DT * options_.deltaTimeMod);
-    glDispatchCompute((PARTICLE_COUNT + 32 - 1) / 32 * 32, 1, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, unsortedParticles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufPrevPositions_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufCounters_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, bufTimestep_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bufAccelerations_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, bufLiveCount_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, bufCellKeys_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, bufSortedCellKeys_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, bufOccupancy_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, bufBrickOccupancy_);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufLiveCount_);
+
+    if (emitCount > 0)
+    {
+      graph_.pass("Emit").storageWrite(unsortedParticles).storageRead(bufTimestep_).storageRead(bufLiveCount_).submit();
+      glUseProgram(programSimEmit_);
+      glProgramUniform1ui(programSimEmit_, 0, PARTICLE_COUNT);
+      glProgramUniform1ui(programSimEmit_, 1, emitCount);
+      glProgramUniform3fv(programSimEmit_, 2, 1, glm::value_ptr(EMITTER_POSITION));
+      glProgramUniform3fv(programSimEmit_, 3, 1, glm::value_ptr(EMITTER_DIRECTION));
+      glProgramUniform1f(programSimEmit_, 4, EMITTER_RADIUS);
+      glProgramUniform1f(programSimEmit_, 5, options_.emitterSpeed);
+      glProgramUniform1ui(programSimEmit_, 6, static_cast<std::uint32_t>(stepCount_));
+      glDispatchCompute((emitCount + workGroups_.particle - 1) / workGroups_.particle, 1, 1);
+    }
+
+    const std::uint32_t uiClearValue = 0;
+
+    if (fullSort)
+    {
+      graph_.pass("Grid clear")
+        .textureUpdate(texGrid_)
+        .bufferUpdate(bufOccupancy_)
+        .bufferUpdate(bufBrickOccupancy_)
+        .submit();
+      glClearTexImage(texGrid_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+      glClearNamedBufferData(bufOccupancy_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+      glClearNamedBufferData(bufBrickOccupancy_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+    }
+    else
+    {
+      graph_.pass("Stale count clear").bufferUpdate(bufCounters_).submit();
+      glClearNamedBufferSubData(bufCounters_, GL_R32UI, sizeof(std::uint32_t), 2 * sizeof(std::uint32_t),
+                                GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+    }
+
+    graph_.pass("Live count").storageWrite(bufLiveCount_).submit();
+    glUseProgram(programSimLiveCount_);
+    glProgramUniform1ui(programSimLiveCount_, 0, PARTICLE_COUNT);
+    glProgramUniform1ui(programSimLiveCount_, 1, emitCount);
+    glProgramUniform1i(programSimLiveCount_, 2, 0);
+    glDispatchCompute(1, 1, 1);
+
+    graph_.pass("Step 1")
+      .storageWrite(unsortedParticles)
+      .storageWrite(bufPrevPositions_)
+      .storageWrite(bufCellKeys_)
+      .storageRead(bufSortedCellKeys_)
+      .storageWrite(bufCounters_)
+      .storageRead(bufTimestep_)
+      .storageRead(bufLiveCount_)
+      .indirectRead(bufLiveCount_)
+      .imageWrite(texGrid_)
+      .textureRead(texObstacleSdf_)
+      .submit();
+    glUseProgram(programStep1);
+    GlHelper::setImageUniform(programStep1, 0, texGridImgHandle_);
+    glProgramUniform3fv(programStep1, 1, 1, glm::value_ptr(invCellSize));
+    glProgramUniform3fv(programStep1, 2, 1, glm::value_ptr(GRID_ORIGIN));
+    glProgramUniform3fv(programStep1, 3, 1, glm::value_ptr(GRID_SIZE));
+    GlHelper::setTextureUniform(programStep1, 4, texObstacleSdfHandle_);
+    glProgramUniform1i(programStep1, 5, (options_.obstacle && obstacleVertexCount_ > 0) ? 1 : 0);
+    glProgramUniform1f(programStep1, 6, PARTICLE_RADIUS);
+    glProgramUniform3fv(programStep1, 7, 1, glm::value_ptr(externalAcceleration));
+    glProgramUniform1i(programStep1, 8, options_.sink ? 1 : 0);
+    glProgramUniform3fv(programStep1, 9, 1, glm::value_ptr(SINK_MIN));
+    glProgramUniform3fv(programStep1, 10, 1, glm::value_ptr(SINK_MAX));
+    glProgramUniform1i(programStep1, 11, !fullSort ? 2 : (radixSort ? 0 : 1));
+    glDispatchComputeIndirect(sizeof(std::uint32_t));
     glEndQuery(GL_TIME_ELAPSED);
 
     // Step 2: Write global particle array offsets into voxel grid.
     glBeginQuery(GL_TIME_ELAPSED, query[1]);
-    const std::uint32_t uiClearValue = 0;
-    glClearNamedBufferData(bufCounters_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
-    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
-
-    glUseProgram(programSimStep2_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufCounters_);
-    glProgramUniformHandleui64ARB(programSimStep2_, 0, texGridImgHandle_);
-    glProgramUniform3iv(programSimStep2_, 1, 1, glm::value_ptr(GRID_RES));
-    glDispatchCompute(
-      (GRID_RES.x + 4 - 1) / 4 * 4,
-      (GRID_RES.y + 4 - 1) / 4 * 4,
-      (GRID_RES.z + 4 - 1) / 4 * 4
-    );
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    if (fullSort)
+    {
+      graph_.pass("Counter clear").bufferUpdate(bufCounters_).submit();
+      glClearNamedBufferData(bufCounters_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+    }
+
+    // Incremental steps keep the grid of the last full sort.
+    if (fullSort && radixSort)
+    {
+      // Radix sort path: sort the cell keys by RADIX_BITS per pass, with the particle indices as
+      // payload. Every pass counts the digits per tile, scans the counts and scatters stably.
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, bufRadixHistogram_);
+
+      for (std::uint32_t pass = 0; pass < radixPasses_; ++pass)
+      {
+        const GLuint keysIn = (pass == 0) ? bufCellKeys_ : bufRadixKeys_[(pass + 1) % 2];
+        const GLuint keysOut = bufRadixKeys_[pass % 2];
+        const GLuint valuesIn = bufRadixValues_[(pass + 1) % 2];
+        const GLuint valuesOut = bufRadixValues_[pass % 2];
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, keysIn);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, keysOut);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, valuesIn);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, valuesOut);
+
+        graph_.pass("Radix histogram")
+          .storageRead(keysIn)
+          .storageWrite(bufRadixHistogram_)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufLiveCount_)
+          .submit();
+        glUseProgram(programRadixHistogram_);
+        glProgramUniform1ui(programRadixHistogram_, 0, pass * RADIX_BITS);
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+        graph_.pass("Radix scan").storageWrite(bufRadixHistogram_).storageRead(bufLiveCount_).submit();
+        glUseProgram(programRadixScan_);
+        glDispatchCompute(1, 1, 1);
+
+        graph_.pass("Radix scatter")
+          .storageRead(keysIn)
+          .storageRead(valuesIn)
+          .storageRead(bufRadixHistogram_)
+          .storageWrite(keysOut)
+          .storageWrite(valuesOut)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufLiveCount_)
+          .submit();
+        glUseProgram(programRadixScatter_);
+        glProgramUniform1ui(programRadixScatter_, 0, pass * RADIX_BITS);
+        glProgramUniform1i(programRadixScatter_, 1, pass == 0 ? 1 : 0);
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+      }
+    }
+    else if (fullSort)
+    {
+      graph_.pass("Step 2")
+        .storageWrite(bufCounters_)
+        .storageWrite(bufOccupancy_)
+        .storageWrite(bufBrickOccupancy_)
+        .imageWrite(texGrid_)
+        .submit();
+      glUseProgram(programStep2);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufCounters_);
+      GlHelper::setImageUniform(programStep2, 0, texGridImgHandle_);
+      glProgramUniform3iv(programStep2, 1, 1, glm::value_ptr(GRID_RES));
+      glDispatchCompute(
+        (GRID_RES.x + workGroups_.grid.x - 1) / workGroups_.grid.x,
+        (GRID_RES.y + workGroups_.grid.y - 1) / workGroups_.grid.y,
+        (GRID_RES.z + workGroups_.grid.z - 1) / workGroups_.grid.z
+      );
+    }
     glEndQuery(GL_TIME_ELAPSED);
 
     // Step 3: Write particles to new location in second particle buffer.
     //         Write particle count to voxel grid (again).
+    //         Particles removed by the sink are skipped, the live count becomes the binned count.
     glBeginQuery(GL_TIME_ELAPSED, query[2]);
-    glUseProgram(programSimStep3_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles1_ : bufParticles2_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, swapFrame_ ? bufParticles2_ : bufParticles1_);
-    glProgramUniformHandleui64ARB(programSimStep3_, 0, texGridImgHandle_);
-    glProgramUniform3fv(programSimStep3_, 1, 1, glm::value_ptr(invCellSize));
-    glProgramUniform3fv(programSimStep3_, 2, 1, glm::value_ptr(GRID_ORIGIN));
-    glProgramUniform1ui(programSimStep3_, 3, PARTICLE_COUNT);
-    glDispatchCompute((PARTICLE_COUNT + 32 - 1) / 32 * 32, 1, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, unsortedParticles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sortedParticles);
+    // Incremental steps keep the particles in place, the grid ranges stay valid.
+    if (fullSort && radixSort)
+    {
+      // Radix sort path: gather the particles by the sorted indices, extract the cell ranges.
+      const GLuint sortedKeys = bufRadixKeys_[(radixPasses_ + 1) % 2];
+      const GLuint sortedValues = bufRadixValues_[(radixPasses_ + 1) % 2];
+      graph_.pass("Radix ranges")
+        .storageRead(unsortedParticles)
+        .storageWrite(sortedParticles)
+        .storageRead(sortedKeys)
+        .storageRead(sortedValues)
+        .storageWrite(bufSortedCellKeys_)
+        .storageWrite(bufCounters_)
+        .storageWrite(bufOccupancy_)
+        .storageWrite(bufBrickOccupancy_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .imageWrite(texGrid_)
+        .submit();
+      glUseProgram(programRadixRanges_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufCounters_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, sortedKeys);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedValues);
+      GlHelper::setImageUniform(programRadixRanges_, 0, texGridImgHandle_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+    }
+    else if (fullSort)
+    {
+      graph_.pass("Step 3")
+        .storageRead(unsortedParticles)
+        .storageWrite(sortedParticles)
+        .storageRead(bufCellKeys_)
+        .storageWrite(bufSortedCellKeys_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .imageWrite(texGrid_)
+        .submit();
+      glUseProgram(programStep3);
+      GlHelper::setImageUniform(programStep3, 0, texGridImgHandle_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+    }
+
+    if (fullSort)
+    {
+      graph_.pass("Binned count").storageRead(bufCounters_).storageWrite(bufLiveCount_).submit();
+      glUseProgram(programSimLiveCount_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufCounters_);
+      glProgramUniform1i(programSimLiveCount_, 2, 1);
+      glDispatchCompute(1, 1, 1);
+
+      binsValid_ = true;
+      forceSort = false;
+      stepsSinceSort_ = 0;
+      ++fullSortSteps;
+    }
+    else
+    {
+      ++stepsSinceSort_;
+    }
+    lastStepSorted_ = fullSort;
     glEndQuery(GL_TIME_ELAPSED);
 
+    // Steps 5 and 6 center the neighbor search on the current cell of a particle, which only
+    // matches the sorted keys right after a full sort. They widen it by the cell drift.
+    const GLuint stepCellKeys = fullSort ? bufSortedCellKeys_ : bufCellKeys_;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, stepCellKeys);
+
     // Step 4: Write average voxel velocities into second 3D-texture.
+    //         Steps 4 and 5 only feed the force based solvers, PBF computes its own density.
     glBeginQuery(GL_TIME_ELAPSED, query[3]);
-    glUseProgram(programSimStep4_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles2_ : bufParticles1_);
-    glProgramUniformHandleui64ARB(programSimStep4_, 0, texGridImgHandle_);
-    glProgramUniformHandleui64ARB(programSimStep4_, 1, texVelocityImgHandle_);
-    glProgramUniform3iv(programSimStep4_, 2, 1, glm::value_ptr(GRID_RES));
-    glDispatchCompute(
-      (GRID_RES.x / 4) + 1,
-      (GRID_RES.y / 4) + 1,
-      (GRID_RES.z / 4) + 1
-    );
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    if (options_.solverMode != 2)
+    {
+      graph_.pass("Step 4")
+        .storageRead(sortedParticles)
+        .storageRead(bufBrickOccupancy_)
+        .storageWrite(bufVelocityBricks_)
+        .imageRead(texGrid_)
+        .imageWrite(texVelocity_)
+        .submit();
+      glUseProgram(programSimStep4_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, bufVelocityBricks_);
+      GlHelper::setImageUniform(programSimStep4_, 0, texGridImgHandle_);
+      GlHelper::setImageUniform(programSimStep4_, 1, texVelocityImgHandle_);
+      glProgramUniform3iv(programSimStep4_, 2, 1, glm::value_ptr(GRID_RES));
+      glDispatchCompute(
+        (GRID_RES.x + workGroups_.grid.x - 1) / workGroups_.grid.x,
+        (GRID_RES.y + workGroups_.grid.y - 1) / workGroups_.grid.y,
+        (GRID_RES.z + workGroups_.grid.z - 1) / workGroups_.grid.z
+      );
+    }
     glEndQuery(GL_TIME_ELAPSED);
 
-    // Step 5: Compute density and pressure for each particle.
+    // Step 5: Compute density and pressure for each particle. With sleeping, only the particles
+    //         of awake cells are processed: the cells are compacted into a list first and steps 5
+    //         and 6 run one work group per list entry (indirect dispatch).
     glBeginQuery(GL_TIME_ELAPSED, query[4]);
-    glUseProgram(programSimStep5_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles2_ : bufParticles1_);
-    glProgramUniformHandleui64ARB(programSimStep5_, 0, texGridImgHandle_);
-    glProgramUniform3fv(programSimStep5_, 1, 1, glm::value_ptr(invCellSize));
-    glProgramUniform3fv(programSimStep5_, 2, 1, glm::value_ptr(GRID_ORIGIN));
-    glProgramUniform3iv(programSimStep5_, 3, 1, glm::value_ptr(GRID_RES));
-    glProgramUniform1ui(programSimStep5_, 4, PARTICLE_COUNT);
-    glProgramUniform1f(programSimStep5_, 5, MASS);
-    glProgramUniform1f(programSimStep5_, 6, KERNEL_RADIUS);
-    glProgramUniform1f(programSimStep5_, 7, weightConstKernel_);
-    glProgramUniform1f(programSimStep5_, 8, STIFFNESS);
-    glProgramUniform1f(programSimStep5_, 9, REST_DENSITY);
-    glProgramUniform1f(programSimStep5_, 10, REST_PRESSURE);
-    glDispatchCompute((PARTICLE_COUNT + 32 - 1) / 32 * 32, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if (sleeping)
+    {
+      if (!sleepingActive_)
+      {
+        graph_.pass("Sleep state clear").textureUpdate(texCellMotion_).textureUpdate(texCellQuietSteps_).submit();
+        glClearTexImage(texCellMotion_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+        glClearTexImage(texCellQuietSteps_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+      }
+
+      graph_.pass("Sleep args upload").bufferUpdate(bufSleepArgs_).submit();
+      const std::uint32_t sleepArgs[3] = { 0, 1, 1 };
+      glNamedBufferSubData(bufSleepArgs_, 0, sizeof(sleepArgs), sleepArgs);
+
+      graph_.pass("Sleep")
+        .storageWrite(sortedParticles)
+        .storageWrite(bufActiveCells_)
+        .storageWrite(bufSleepArgs_)
+        .imageRead(texGrid_)
+        .imageRead(texCellMotion_)
+        .imageWrite(texCellQuietSteps_)
+        .submit();
+      glUseProgram(programSimSleep_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bufActiveCells_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bufSleepArgs_);
+      GlHelper::setImageUniform(programSimSleep_, 0, texGridImgHandle_);
+      GlHelper::setImageUniform(programSimSleep_, 1, texCellMotionImgHandle_);
+      GlHelper::setImageUniform(programSimSleep_, 2, texCellQuietStepsImgHandle_);
+      glProgramUniform3iv(programSimSleep_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1ui(programSimSleep_, 4, SLEEP_STEPS);
+      glDispatchCompute((GRID_RES.x + 3) / 4, (GRID_RES.y + 3) / 4, (GRID_RES.z + 3) / 4);
+
+      // Motion of this step is marked by steps 5 and 6 for the next one.
+      graph_.pass("Motion clear").textureUpdate(texCellMotion_).submit();
+      glClearTexImage(texCellMotion_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &uiClearValue);
+    }
+    sleepingActive_ = sleeping;
+
+    if (options_.solverMode != 2)
+    {
+      graph_.pass("Step 5")
+        .storageWrite(sortedParticles)
+        .storageRead(stepCellKeys)
+        .storageRead(bufOccupancy_)
+        .storageRead(bufCounters_)
+        .storageRead(bufActiveCells_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(sleeping ? bufSleepArgs_ : bufLiveCount_)
+        .imageRead(texGrid_)
+        .imageWrite(texCellMotion_)
+        .submit();
+      const GLuint programStep5 = programsSimStep5_[neighborVariant];
+      glUseProgram(programStep5);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufCounters_);
+      GlHelper::setImageUniform(programStep5, 0, texGridImgHandle_);
+      if (sleeping)
+      {
+        GlHelper::setImageUniform(programStep5, 11, texCellMotionImgHandle_);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufSleepArgs_);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufLiveCount_);
+      }
+      else
+      {
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+      }
+    }
     glEndQuery(GL_TIME_ELAPSED);
 
-    // Step 6: Compute pressure and viscosity forces, use them to write new velocity.
-    //         For the old velocity, we use the coarse 3d-texture and do trilinear HW filtering.
     glBeginQuery(GL_TIME_ELAPSED, query[5]);
-    glUseProgram(programSimStep6_);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles2_ : bufParticles1_);
-    glProgramUniformHandleui64ARB(programSimStep6_, 0, texGridImgHandle_);
-    glProgramUniformHandleui64ARB(programSimStep6_, 1, texVelocityHandle_);
-    glProgramUniform3fv(programSimStep6_, 2, 1, glm::value_ptr(invCellSize));
-    glProgramUniform1f(programSimStep6_, 3, DT * options_.deltaTimeMod);
-    glProgramUniform3fv(programSimStep6_, 4, 1, glm::value_ptr(GRID_SIZE));
-    glProgramUniform3fv(programSimStep6_, 5, 1, glm::value_ptr(GRID_ORIGIN));
-    glProgramUniform1ui(programSimStep6_, 6, PARTICLE_COUNT);
-    glProgramUniform3iv(programSimStep6_, 7, 1, glm::value_ptr(GRID_RES));
-    glProgramUniform3fv(programSimStep6_, 8, 1, &options_.gravity[0]);
-    glProgramUniform1f(programSimStep6_, 9, MASS);
-    glProgramUniform1f(programSimStep6_, 10, KERNEL_RADIUS);
-    glProgramUniform1f(programSimStep6_, 11, VIS_COEFF);
-    glProgramUniform1f(programSimStep6_, 12, weightConstViscosity_);
-    glProgramUniform1f(programSimStep6_, 13, weightConstPressure_);
-    glDispatchCompute((PARTICLE_COUNT + 32 - 1) / 32 * 32, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if (options_.solverMode == 1)
+    {
+      // Step 6: PCISPH. Predict positions, correct pressure from the density error and repeat
+      //         until the GPU reports convergence. The iterations are dispatched from the solver
+      //         state, whose group count the check pass sets to zero once converged.
+      // delta = 1 / (beta * gradients) with beta = 2 (dt m / rho0)^2, the shader divides by dt^2.
+      const float beta = 2.0f * (MASS / latticeRestDensity_) * (MASS / latticeRestDensity_);
+      const float deltaScale = (beta * pcisphGradientSum_ > 0.0f) ? 1.0f / (beta * pcisphGradientSum_) : 0.0f;
+
+      graph_.pass("Solver state reset").bufferUpdate(bufSolverState_).bufferUpdate(bufLiveCount_).submit();
+      const std::uint32_t solverReset[3] = { 0, 0, 0 };
+      glNamedBufferSubData(bufSolverState_, 0, sizeof(solverReset), solverReset);
+      glCopyNamedBufferSubData(bufLiveCount_, bufSolverState_, sizeof(std::uint32_t), 5 * sizeof(std::uint32_t), 3 * sizeof(std::uint32_t));
+
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufPredictedPositions_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufAccelNonPressure_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufAccelPressure_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bufSolverState_);
+
+      graph_.pass("PCISPH init")
+        .storageWrite(sortedParticles)
+        .storageWrite(bufAccelNonPressure_)
+        .storageWrite(bufAccelPressure_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .imageRead(texGrid_)
+        .textureRead(texVelocity_)
+        .submit();
+      glUseProgram(programPcisphInit_);
+      GlHelper::setImageUniform(programPcisphInit_, 0, texGridImgHandle_);
+      GlHelper::setTextureUniform(programPcisphInit_, 1, texVelocityHandle_);
+      glProgramUniform3fv(programPcisphInit_, 2, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPcisphInit_, 3, 1, glm::value_ptr(GRID_SIZE));
+      glProgramUniform3fv(programPcisphInit_, 4, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPcisphInit_, 5, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform3fv(programPcisphInit_, 6, 1, &options_.gravity[0]);
+      glProgramUniform1f(programPcisphInit_, 7, MASS);
+      glProgramUniform1f(programPcisphInit_, 8, KERNEL_RADIUS);
+      glProgramUniform1f(programPcisphInit_, 9, VIS_COEFF);
+      glProgramUniform1f(programPcisphInit_, 10, weightConstViscosity_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+      glProgramUniform3fv(programPcisphPredict_, 0, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3fv(programPcisphPredict_, 1, 1, glm::value_ptr(GRID_SIZE));
+
+      GlHelper::setImageUniform(programPcisphDensity_, 0, texGridImgHandle_);
+      glProgramUniform3fv(programPcisphDensity_, 1, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPcisphDensity_, 2, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPcisphDensity_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1f(programPcisphDensity_, 4, MASS);
+      glProgramUniform1f(programPcisphDensity_, 5, KERNEL_RADIUS);
+      glProgramUniform1f(programPcisphDensity_, 6, weightConstKernel_);
+      glProgramUniform1f(programPcisphDensity_, 7, latticeRestDensity_);
+      glProgramUniform1f(programPcisphDensity_, 8, deltaScale);
+
+      glProgramUniform1ui(programPcisphCheck_, 0, PCISPH_MIN_ITERATIONS);
+      glProgramUniform1ui(programPcisphCheck_, 1, PCISPH_MAX_ITERATIONS);
+      glProgramUniform1f(programPcisphCheck_, 2, options_.pcisphTolerance);
+
+      GlHelper::setImageUniform(programPcisphPressure_, 0, texGridImgHandle_);
+      glProgramUniform3fv(programPcisphPressure_, 1, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPcisphPressure_, 2, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPcisphPressure_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1f(programPcisphPressure_, 4, MASS);
+      glProgramUniform1f(programPcisphPressure_, 5, KERNEL_RADIUS);
+      glProgramUniform1f(programPcisphPressure_, 6, weightConstPressure_);
+      glProgramUniform1f(programPcisphPressure_, 7, latticeRestDensity_);
+
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufSolverState_);
+      for (std::uint32_t i = 0; i < PCISPH_MAX_ITERATIONS; ++i)
+      {
+        graph_.pass("PCISPH predict")
+          .storageRead(sortedParticles)
+          .storageWrite(bufPredictedPositions_)
+          .storageRead(bufAccelNonPressure_)
+          .storageRead(bufAccelPressure_)
+          .storageRead(bufTimestep_)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufSolverState_)
+          .submit();
+        glUseProgram(programPcisphPredict_);
+        glDispatchComputeIndirect(5 * sizeof(std::uint32_t));
+
+        graph_.pass("PCISPH density")
+          .storageWrite(sortedParticles)
+          .storageRead(bufPredictedPositions_)
+          .storageWrite(bufSolverState_)
+          .storageRead(bufTimestep_)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufSolverState_)
+          .imageRead(texGrid_)
+          .submit();
+        glUseProgram(programPcisphDensity_);
+        glDispatchComputeIndirect(5 * sizeof(std::uint32_t));
+
+        graph_.pass("PCISPH check").storageWrite(bufSolverState_).submit();
+        glUseProgram(programPcisphCheck_);
+        glDispatchCompute(1, 1, 1);
+
+        graph_.pass("PCISPH pressure")
+          .storageRead(sortedParticles)
+          .storageWrite(bufAccelPressure_)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufSolverState_)
+          .imageRead(texGrid_)
+          .submit();
+        glUseProgram(programPcisphPressure_);
+        glDispatchComputeIndirect(5 * sizeof(std::uint32_t));
+      }
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufLiveCount_);
+
+      graph_.pass("PCISPH apply")
+        .storageWrite(sortedParticles)
+        .storageRead(bufAccelNonPressure_)
+        .storageRead(bufAccelPressure_)
+        .storageRead(bufTimestep_)
+        .storageWrite(bufAccelerations_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .submit();
+      glUseProgram(programPcisphApply_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+    }
+    else if (options_.solverMode == 2)
+    {
+      // Step 6: PBF. Iterate the density constraints on the predicted positions (ping-ponged
+      //         between two buffers), then derive the velocity and apply XSPH viscosity.
+      const std::uint32_t iterations = static_cast<std::uint32_t>(std::max(options_.pbfIterations, 1));
+      const float tensileDistance = PBF_TENSILE_DISTANCE * KERNEL_RADIUS;
+      const float tensileWeight = weightConstKernel_ * std::pow(KERNEL_RADIUS * KERNEL_RADIUS - tensileDistance * tensileDistance, 3.0f);
+
+      graph_.pass("Solver state reset").bufferUpdate(bufSolverState_).submit();
+      const std::uint32_t solverReset[3] = { 0, 0, 0 };
+      glNamedBufferSubData(bufSolverState_, 0, sizeof(solverReset), solverReset);
+
+      graph_.pass("PBF init")
+        .storageRead(sortedParticles)
+        .storageWrite(bufPbfPositions1_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .submit();
+      glUseProgram(programPbfInit_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufPbfPositions1_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bufSolverState_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+      GlHelper::setImageUniform(programPbfLambda_, 0, texGridImgHandle_);
+      glProgramUniform3fv(programPbfLambda_, 1, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPbfLambda_, 2, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPbfLambda_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1f(programPbfLambda_, 4, MASS);
+      glProgramUniform1f(programPbfLambda_, 5, KERNEL_RADIUS);
+      glProgramUniform1f(programPbfLambda_, 6, weightConstKernel_);
+      glProgramUniform1f(programPbfLambda_, 7, weightConstPressure_);
+      glProgramUniform1f(programPbfLambda_, 8, latticeRestDensity_);
+      glProgramUniform1f(programPbfLambda_, 9, PBF_RELAXATION);
+
+      GlHelper::setImageUniform(programPbfDelta_, 0, texGridImgHandle_);
+      glProgramUniform3fv(programPbfDelta_, 1, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPbfDelta_, 2, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPbfDelta_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1f(programPbfDelta_, 4, MASS);
+      glProgramUniform1f(programPbfDelta_, 5, KERNEL_RADIUS);
+      glProgramUniform1f(programPbfDelta_, 6, weightConstKernel_);
+      glProgramUniform1f(programPbfDelta_, 7, weightConstPressure_);
+      glProgramUniform1f(programPbfDelta_, 8, latticeRestDensity_);
+      glProgramUniform1f(programPbfDelta_, 9, PBF_TENSILE_STRENGTH);
+      glProgramUniform1f(programPbfDelta_, 10, 1.0f / tensileWeight);
+      glProgramUniform3fv(programPbfDelta_, 11, 1, glm::value_ptr(GRID_SIZE));
+      GlHelper::setTextureUniform(programPbfDelta_, 12, texObstacleSdfHandle_);
+      glProgramUniform1i(programPbfDelta_, 13, (options_.obstacle && obstacleVertexCount_ > 0) ? 1 : 0);
+      glProgramUniform1f(programPbfDelta_, 14, PARTICLE_RADIUS);
+
+      // The PCISPH convergence check only counts iterations and keeps the last density error here.
+      glProgramUniform1ui(programPcisphCheck_, 0, iterations);
+      glProgramUniform1ui(programPcisphCheck_, 1, iterations);
+      glProgramUniform1f(programPcisphCheck_, 2, 0.0f);
+
+      bool swapPositions = false;
+      for (std::uint32_t i = 0; i < iterations; ++i)
+      {
+        const GLuint positionsIn = swapPositions ? bufPbfPositions2_ : bufPbfPositions1_;
+        const GLuint positionsOut = swapPositions ? bufPbfPositions1_ : bufPbfPositions2_;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positionsIn);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, positionsOut);
+
+        graph_.pass("PBF lambda")
+          .storageWrite(sortedParticles)
+          .storageWrite(positionsIn)
+          .storageWrite(bufSolverState_)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufLiveCount_)
+          .imageRead(texGrid_)
+          .submit();
+        glUseProgram(programPbfLambda_);
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+        graph_.pass("PBF check").storageWrite(bufSolverState_).submit();
+        glUseProgram(programPcisphCheck_);
+        glDispatchCompute(1, 1, 1);
+
+        graph_.pass("PBF delta")
+          .storageRead(sortedParticles)
+          .storageRead(positionsIn)
+          .storageWrite(positionsOut)
+          .storageRead(bufLiveCount_)
+          .indirectRead(bufLiveCount_)
+          .imageRead(texGrid_)
+          .textureRead(texObstacleSdf_)
+          .submit();
+        glUseProgram(programPbfDelta_);
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+        swapPositions = !swapPositions;
+      }
+
+      // The solved positions are in the last output buffer, the other one holds the velocities.
+      const GLuint solvedPositions = swapPositions ? bufPbfPositions2_ : bufPbfPositions1_;
+      const GLuint velocities = swapPositions ? bufPbfPositions1_ : bufPbfPositions2_;
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, solvedPositions);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, velocities);
+
+      graph_.pass("PBF velocity")
+        .storageRead(sortedParticles)
+        .storageRead(solvedPositions)
+        .storageWrite(velocities)
+        .storageRead(bufTimestep_)
+        .storageWrite(bufAccelerations_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .submit();
+      glUseProgram(programPbfVelocity_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+      graph_.pass("PBF viscosity")
+        .storageWrite(sortedParticles)
+        .storageRead(solvedPositions)
+        .storageRead(velocities)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .imageRead(texGrid_)
+        .submit();
+      glUseProgram(programPbfViscosity_);
+      GlHelper::setImageUniform(programPbfViscosity_, 0, texGridImgHandle_);
+      glProgramUniform3fv(programPbfViscosity_, 1, 1, glm::value_ptr(invCellSize));
+      glProgramUniform3fv(programPbfViscosity_, 2, 1, glm::value_ptr(GRID_ORIGIN));
+      glProgramUniform3iv(programPbfViscosity_, 3, 1, glm::value_ptr(GRID_RES));
+      glProgramUniform1f(programPbfViscosity_, 4, MASS);
+      glProgramUniform1f(programPbfViscosity_, 5, KERNEL_RADIUS);
+      glProgramUniform1f(programPbfViscosity_, 6, weightConstKernel_);
+      glProgramUniform1f(programPbfViscosity_, 7, latticeRestDensity_);
+      glProgramUniform1f(programPbfViscosity_, 8, PBF_VISCOSITY);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+    }
+    else
+    {
+      // Step 6: Compute pressure and viscosity forces, use them to write new velocity.
+      //         For the old velocity, we use the coarse 3d-texture and do trilinear HW filtering.
+      graph_.pass("Step 6")
+        .storageWrite(sortedParticles)
+        .storageRead(stepCellKeys)
+        .storageRead(bufOccupancy_)
+        .storageRead(bufCounters_)
+        .storageRead(bufTimestep_)
+        .storageWrite(bufAccelerations_)
+        .storageRead(bufActiveCells_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(sleeping ? bufSleepArgs_ : bufLiveCount_)
+        .imageRead(texGrid_)
+        .imageWrite(texCellMotion_)
+        .textureRead(texVelocity_)
+        .submit();
+      const GLuint programStep6 = programsSimStep6_[neighborVariant];
+      glUseProgram(programStep6);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufCounters_);
+      GlHelper::setImageUniform(programStep6, 0, texGridImgHandle_);
+      GlHelper::setTextureUniform(programStep6, 1, texVelocityHandle_);
+      glProgramUniform3fv(programStep6, 6, 1, &options_.gravity[0]);
+      if (sleeping)
+      {
+        GlHelper::setImageUniform(programStep6, 13, texCellMotionImgHandle_);
+        glProgramUniform1f(programStep6, 14, options_.sleepSpeed);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufSleepArgs_);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufLiveCount_);
+      }
+      else
+      {
+        glDispatchComputeIndirect(sizeof(std::uint32_t));
+      }
+    }
+
+    // Adaptive timestep: reduce the maximum speed and acceleration after step 6 and derive the
+    //                    next timestep from a CFL condition, all on the GPU.
+    if (options_.adaptiveTimestep)
+    {
+      graph_.pass("Timestep reduce")
+        .storageRead(sortedParticles)
+        .storageWrite(bufTimestep_)
+        .storageRead(bufAccelerations_)
+        .storageRead(bufLiveCount_)
+        .indirectRead(bufLiveCount_)
+        .submit();
+      glUseProgram(programSimTimestep_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, bufTimestep_);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bufAccelerations_);
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufLiveCount_);
+      glDispatchComputeIndirect(sizeof(std::uint32_t));
+
+      graph_.pass("Timestep update").storageWrite(bufTimestep_).submit();
+      glUseProgram(programSimTimestepUpdate_);
+      glProgramUniform1f(programSimTimestepUpdate_, 0, options_.cflNumber);
+      glProgramUniform1f(programSimTimestepUpdate_, 1, KERNEL_RADIUS);
+      glProgramUniform1f(programSimTimestepUpdate_, 2, (options_.solverMode == 0) ? std::sqrt(STIFFNESS) : 0.0f);
+      glProgramUniform1f(programSimTimestepUpdate_, 3, fixedTimestep() * ADAPTIVE_DT_MIN_SCALE);
+      glProgramUniform1f(programSimTimestepUpdate_, 4, fixedTimestep() * ADAPTIVE_DT_MAX_SCALE);
+      glDispatchCompute(1, 1, 1);
+    }
     glEndQuery(GL_TIME_ELAPSED);
 
-    swapFrame_ = !swapFrame_;
+    if (fullSort)
+    {
+      swapFrame_ = !swapFrame_;
+    }
+    swapQueries_ = !swapQueries_;
+    ++stepCount_;
 
-    lastQuery = timerQueries_[swapFrame_ ? 0 : 1];
-    query = timerQueries_[swapFrame_ ? 1 : 0];
+    lastQuery = timerQueries_[swapQueries_ ? 0 : 1];
+    query = timerQueries_[swapQueries_ ? 1 : 0];
   }
 
-  // Step 7: Render the geometry (points or screen-space spheres).
-  GLuint renderProgram;
-  glBeginQuery(GL_TIME_ELAPSED, query[6]);
-  if (options_.shadingMode == 0) {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    renderProgram = programRenderFlat_;
-  } else {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo1_);
-    renderProgram = programRenderGeometry_;
-  }
-  glUseProgram(renderProgram);
-  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  const float pointRadius = options_.shadingMode ? PARTICLE_RADIUS * 6.0f : PARTICLE_RADIUS * 3.5f;
-  const float pointScale = 650.0f;
+  // Share of the simulation cost (steps 1 to 6) saved by the incremental steps of this frame, from
+  // the smoothed cost of full and incremental steps. Negative if the wider search costs more.
+  if (substeps > 0)
+  {
+    const float incrementalSteps = static_cast<float>(substeps - fullSortSteps);
+    const float savedMs = incrementalSteps * (fullStepMs_ - incrementalStepMs_);
+    stats_.sortSavedFraction = (fullStepMs_ > 0.0f) ? savedMs / (substeps * fullStepMs_) : 0.0f;
+  }
+
+  // Solver statistics and the adaptive timestep are copied aside and read back a frame later,
+  // without stalling.
+  const std::uint32_t solverSlot = frame_ % 2;
+  if (options_.solverMode != 0 && substeps > 0 && !solverFences_[solverSlot])
+  {
+    graph_.pass("Solver state readback").bufferUpdate(bufSolverState_).bufferUpdate(bufSolverReadback_).submit();
+    glCopyNamedBufferSubData(bufSolverState_, bufSolverReadback_, 0, solverSlot * 8 * sizeof(std::uint32_t), 8 * sizeof(std::uint32_t));
+    solverFences_[solverSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    solverReadbackSteps_[solverSlot] = substeps;
+  }
+
+  if (substeps > 0 && !liveCountFences_[solverSlot])
+  {
+    graph_.pass("Live count readback")
+      .bufferUpdate(bufLiveCount_)
+      .bufferUpdate(bufCounters_)
+      .bufferUpdate(bufLiveCountReadback_)
+      .submit();
+    glCopyNamedBufferSubData(bufLiveCount_, bufLiveCountReadback_, 0, solverSlot * 3 * sizeof(std::uint32_t), sizeof(std::uint32_t));
+    glCopyNamedBufferSubData(bufCounters_, bufLiveCountReadback_, sizeof(std::uint32_t),
+                             (solverSlot * 3 + 1) * sizeof(std::uint32_t), 2 * sizeof(std::uint32_t));
+    liveCountFences_[solverSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  if (options_.adaptiveTimestep && substeps > 0 && !timestepFences_[solverSlot])
+  {
+    graph_.pass("Timestep readback").bufferUpdate(bufTimestep_).bufferUpdate(bufTimestepReadback_).submit();
+    glCopyNamedBufferSubData(bufTimestep_, bufTimestepReadback_, 0, solverSlot * TIMESTEP_BUFFER_SIZE, TIMESTEP_BUFFER_SIZE);
+    timestepFences_[solverSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  // Step 7: Render the geometry (points, screen-space spheres or the surface mesh).
+  //         The screen-space fluid path renders into the top-left part of the frame
+  //         objects, scaled to the current render resolution.
   const auto& view = camera.view();
   const auto& projection = camera.projection();
   const auto& invProjection = camera.invProjection();
   const glm::mat4 mvp = projection * view;
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swapFrame_ ? bufParticles2_ : bufParticles1_);
-  glProgramUniformMatrix4fv(renderProgram, 0, 1, GL_FALSE, glm::value_ptr(mvp));
-  glProgramUniformMatrix4fv(renderProgram, 1, 1, GL_FALSE, glm::value_ptr(view));
-  glProgramUniformMatrix4fv(renderProgram, 2, 1, GL_FALSE, glm::value_ptr(projection));
-  glProgramUniform3fv(renderProgram, 3, 1, glm::value_ptr(GRID_SIZE));
-  glProgramUniform3fv(renderProgram, 4, 1, glm::value_ptr(GRID_ORIGIN));
-  glProgramUniform3iv(renderProgram, 5, 1, glm::value_ptr(GRID_RES));
-  glProgramUniform1ui(renderProgram, 6, PARTICLE_COUNT);
-  glProgramUniform1f(renderProgram, 7, pointRadius);
-  glProgramUniform1f(renderProgram, 8, pointScale);
-  glProgramUniform1i(renderProgram, 9, options_.colorMode);
-  glProgramUniform1i(renderProgram, 10, options_.shadingMode);
-  glBindVertexArray(swapFrame_ ? vao2_ : vao1_);
-  glDrawArrays(GL_POINTS, 0, PARTICLE_COUNT);
+  glBeginQuery(GL_TIME_ELAPSED, renderQuery[6]);
+  if (options_.shadingMode == 2)
+  {
+    // Marching cubes surface of the current simulation state, drawn with the counts from the GPU.
+    extractSurface();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    graph_.pass("Mesh").vertexRead(bufMeshVertices_).indirectRead(bufMeshCounters_).submit();
+    glUseProgram(programRenderMesh_);
+    glProgramUniformMatrix4fv(programRenderMesh_, 0, 1, GL_FALSE, glm::value_ptr(mvp));
+    glProgramUniformMatrix4fv(programRenderMesh_, 1, 1, GL_FALSE, glm::value_ptr(view));
+    glProgramUniform3f(programRenderMesh_, 2, 0.0f, 0.0f, 0.6f);
+    glBindVertexArray(vao4_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, bufMeshCounters_);
+    glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+    renderObstacle(mvp, view);
+  }
+  else
+  {
+    const GLuint renderProgram = renderGeometryProgram(options_.colorMode, options_.shadingMode);
+    float pointScale = 650.0f;
+    if (options_.shadingMode == 0) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    } else {
+      depthTarget_ = renderTargets_.acquire(GL_DEPTH_COMPONENT24, width_, height_);
+      colorTarget_ = renderTargets_.acquire(COLOR_FORMATS[frameColorFormat_], width_, height_);
+      glNamedFramebufferTexture(fbo1_, GL_DEPTH_ATTACHMENT, depthTarget_.texture, 0);
+      glNamedFramebufferTexture(fbo1_, GL_COLOR_ATTACHMENT0, colorTarget_.texture, 0);
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo1_);
+      graph_.pass("Geometry targets").framebufferWrite(depthTarget_.texture).framebufferWrite(colorTarget_.texture).submit();
+      glViewport(0, 0, renderWidth, renderHeight);
+      pointScale *= stats_.renderScale;
+    }
+    glUseProgram(renderProgram);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const float pointRadius = options_.shadingMode ? PARTICLE_RADIUS * 6.0f : PARTICLE_RADIUS * 3.5f;
+    // Particles are drawn interpolated between the last two simulation states.
+    const float alpha = (stepDt > 0.0f) ? std::min(accumulator_ / stepDt, 1.0f) : 1.0f;
+    // The buffer integrated last: the unsorted one of a full sort, the only one of an incremental step.
+    const bool secondBuffer = lastStepSorted_ ? swapFrame_ : !swapFrame_;
+    const GLuint particles = secondBuffer ? bufParticles2_ : bufParticles1_;
+    graph_.pass("Geometry")
+      .storageRead(particles)
+      .storageRead(bufPrevPositions_)
+      .vertexRead(particles)
+      .indirectRead(bufLiveCount_)
+      .submit();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufPrevPositions_);
+    glProgramUniformMatrix4fv(renderProgram, 0, 1, GL_FALSE, glm::value_ptr(mvp));
+    glProgramUniformMatrix4fv(renderProgram, 1, 1, GL_FALSE, glm::value_ptr(view));
+    if (options_.shadingMode == 1)
+    {
+      glProgramUniformMatrix4fv(renderProgram, 2, 1, GL_FALSE, glm::value_ptr(projection));
+    }
+    glProgramUniform1f(renderProgram, 7, pointRadius);
+    glProgramUniform1f(renderProgram, 8, pointScale);
+    glProgramUniform1f(renderProgram, 11, alpha);
+    glBindVertexArray(secondBuffer ? vao2_ : vao1_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, bufLiveCount_);
+    glDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void*>(4 * sizeof(std::uint32_t)));
+
+    if (options_.shadingMode == 0)
+    {
+      renderObstacle(mvp, view);
+    }
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+
+  glBeginQuery(GL_TIME_ELAPSED, renderQuery[7]);
+  GLuint inputDepthTexture = depthTarget_.texture;
+  GLuint64 inputDepthTexHandle = depthTarget_.handle;
+  std::int32_t inputDepthEncoding = DEPTH_ENCODING_WINDOW;
+  const std::int32_t smoothedDepthEncoding = frameSmoothingFormat_;
+  texSmoothedDepth_ = depthTarget_.texture;
 
   if (options_.shadingMode == 1)
   {
-    // Step 7.1: Perform curvature flow (multiple iterations).
+    // Step 7.1: Perform curvature flow (multiple iterations) or a separable depth filter.
+    const GLenum smoothingFormat = SMOOTHING_FORMATS[frameSmoothingFormat_];
+    smoothTargets_[0] = renderTargets_.acquire(smoothingFormat, width_, height_, true);
+    smoothTargets_[1] = renderTargets_.acquire(smoothingFormat, width_, height_, true);
+    glNamedFramebufferTexture(fbo2_, GL_COLOR_ATTACHMENT0, smoothTargets_[0].texture, 0);
+    glNamedFramebufferTexture(fbo3_, GL_COLOR_ATTACHMENT0, smoothTargets_[1].texture, 0);
     glDisable(GL_DEPTH_TEST);
     glBindVertexArray(vao3_);
-    glUseProgram(programRenderCurvature_);
-    glProgramUniformMatrix4fv(programRenderCurvature_, 0, 1, GL_FALSE, glm::value_ptr(mvp));
-    glProgramUniformMatrix4fv(programRenderCurvature_, 2, 1, GL_FALSE, glm::value_ptr(projection));
-    glProgramUniform2i(programRenderCurvature_, 3, width_, height_);
-    GLuint64 inputDepthTexHandle = texDepthHandle_;
     bool swap = false;
 
-    for (std::uint32_t i = 0; i < SMOOTH_ITERATIONS; ++i)
+    if (options_.smoothingMode == 0)
+    {
+      glUseProgram(programRenderCurvature_);
+      glProgramUniformMatrix4fv(programRenderCurvature_, 0, 1, GL_FALSE, glm::value_ptr(mvp));
+      glProgramUniformMatrix4fv(programRenderCurvature_, 2, 1, GL_FALSE, glm::value_ptr(projection));
+      glProgramUniform2i(programRenderCurvature_, 3, renderWidth, renderHeight);
+      glProgramUniform1i(programRenderCurvature_, 5, smoothedDepthEncoding);
+
+      for (std::uint32_t i = 0; i < SMOOTH_ITERATIONS; ++i)
+      {
+        graph_.pass("Curvature flow")
+          .textureRead(inputDepthTexture)
+          .framebufferWrite(swap ? smoothTargets_[1].texture : smoothTargets_[0].texture)
+          .submit();
+        glBindFramebuffer(GL_FRAMEBUFFER, swap ? fbo3_ : fbo2_);
+        glClear(GL_COLOR_BUFFER_BIT);
+        GlHelper::setTextureUniform(programRenderCurvature_, 1, inputDepthTexHandle);
+        glProgramUniform1i(programRenderCurvature_, 4, inputDepthEncoding);
+        glDrawElements(GL_TRIANGLES, 32, GL_UNSIGNED_INT, nullptr);
+        inputDepthTexture = swap ? smoothTargets_[1].texture : smoothTargets_[0].texture;
+        inputDepthTexHandle = swap ? smoothTargets_[1].handle : smoothTargets_[0].handle;
+        inputDepthEncoding = smoothedDepthEncoding;
+        swap = !swap;
+      }
+    }
+    else if (options_.smoothingMode == 1)
     {
-      glBindFramebuffer(GL_FRAMEBUFFER, swap ? fbo3_ : fbo2_);
-      glClear(GL_COLOR_BUFFER_BIT);
-      glProgramUniformHandleui64ARB(programRenderCurvature_, 1, inputDepthTexHandle);
-      glDrawElements(GL_TRIANGLES, 32, GL_UNSIGNED_INT, nullptr);
-      inputDepthTexHandle = swap ? texTemp2Handle_ : texTemp1Handle_;
-      swap = !swap;
+      // Tiled variant: each dispatch keeps a tile plus apron in shared memory and
+      // runs several iterations on it before writing the result back once.
+      glUseProgram(programRenderCurvatureTiled_);
+      glProgramUniformMatrix4fv(programRenderCurvatureTiled_, 2, 1, GL_FALSE, glm::value_ptr(projection));
+      glProgramUniform2i(programRenderCurvatureTiled_, 3, renderWidth, renderHeight);
+      glProgramUniform1i(programRenderCurvatureTiled_, 6, smoothedDepthEncoding);
+
+      for (std::uint32_t i = 0; i < SMOOTH_ITERATIONS; i += SMOOTH_ITERATIONS_PER_DISPATCH)
+      {
+        const std::uint32_t iterations = std::min(SMOOTH_ITERATIONS - i, SMOOTH_ITERATIONS_PER_DISPATCH);
+        graph_.pass("Tiled curvature flow")
+          .textureRead(inputDepthTexture)
+          .imageWrite(swap ? smoothTargets_[1].texture : smoothTargets_[0].texture)
+          .submit();
+        GlHelper::setTextureUniform(programRenderCurvatureTiled_, 0, inputDepthTexHandle);
+        GlHelper::setImageUniform(programRenderCurvatureTiled_, 1, swap ? smoothTargets_[1].imageHandle : smoothTargets_[0].imageHandle);
+        glProgramUniform1i(programRenderCurvatureTiled_, 4, iterations);
+        glProgramUniform1i(programRenderCurvatureTiled_, 5, inputDepthEncoding);
+        glDispatchCompute(
+          (renderWidth + SMOOTH_TILE_SIZE - 1) / SMOOTH_TILE_SIZE,
+          (renderHeight + SMOOTH_TILE_SIZE - 1) / SMOOTH_TILE_SIZE,
+          1
+        );
+        inputDepthTexture = swap ? smoothTargets_[1].texture : smoothTargets_[0].texture;
+        inputDepthTexHandle = swap ? smoothTargets_[1].handle : smoothTargets_[0].handle;
+        inputDepthEncoding = smoothedDepthEncoding;
+        swap = !swap;
+      }
     }
+    else
+    {
+      // Narrow-range filter: horizontal and vertical pass per iteration.
+      glUseProgram(programRenderBilateral_);
+      glProgramUniformMatrix4fv(programRenderBilateral_, 2, 1, GL_FALSE, glm::value_ptr(projection));
+      glProgramUniform2i(programRenderBilateral_, 3, renderWidth, renderHeight);
+      glProgramUniform1i(programRenderBilateral_, 6, smoothedDepthEncoding);
 
-    // Step 7.2: Do blinn-phong shading.
+      for (std::uint32_t i = 0; i < SMOOTH_FILTER_ITERATIONS * 2; ++i)
+      {
+        graph_.pass("Bilateral filter")
+          .textureRead(inputDepthTexture)
+          .imageWrite(swap ? smoothTargets_[1].texture : smoothTargets_[0].texture)
+          .submit();
+        GlHelper::setTextureUniform(programRenderBilateral_, 0, inputDepthTexHandle);
+        GlHelper::setImageUniform(programRenderBilateral_, 1, swap ? smoothTargets_[1].imageHandle : smoothTargets_[0].imageHandle);
+        glProgramUniform2i(programRenderBilateral_, 4, (i % 2) == 0 ? 1 : 0, (i % 2) == 0 ? 0 : 1);
+        glProgramUniform1i(programRenderBilateral_, 5, inputDepthEncoding);
+        glDispatchCompute((renderWidth + SMOOTH_TILE_SIZE - 1) / SMOOTH_TILE_SIZE, (renderHeight + SMOOTH_TILE_SIZE - 1) / SMOOTH_TILE_SIZE, 1);
+        inputDepthTexture = swap ? smoothTargets_[1].texture : smoothTargets_[0].texture;
+        inputDepthTexHandle = swap ? smoothTargets_[1].handle : smoothTargets_[0].handle;
+        inputDepthEncoding = smoothedDepthEncoding;
+        swap = !swap;
+      }
+    }
+
+    texSmoothedDepth_ = swap ? smoothTargets_[0].texture : smoothTargets_[1].texture;
+
+    // The other ping-pong target is free for later passes.
+    renderTargets_.release(swap ? smoothTargets_[1] : smoothTargets_[0]);
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+
+  glBeginQuery(GL_TIME_ELAPSED, renderQuery[8]);
+  if (options_.shadingMode == 1)
+  {
+    // Step 7.2: Do blinn-phong shading, upscaling to the full backbuffer resolution.
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width_, height_);
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Obstacles first, the fluid is depth tested against them.
+    glEnable(GL_DEPTH_TEST);
+    renderObstacle(mvp, view);
+
+    graph_.pass("Shading").textureRead(inputDepthTexture).textureRead(colorTarget_.texture).submit();
     glUseProgram(programRenderShading_);
     glProgramUniformMatrix4fv(programRenderShading_, 0, 1, GL_FALSE, glm::value_ptr(mvp));
-    glProgramUniformHandleui64ARB(programRenderShading_, 1, inputDepthTexHandle);
-    glProgramUniformHandleui64ARB(programRenderShading_, 2, texColorHandle_);
+    GlHelper::setTextureUniform(programRenderShading_, 1, inputDepthTexHandle);
+    GlHelper::setTextureUniform(programRenderShading_, 2, colorTarget_.handle);
     glProgramUniform1ui(programRenderShading_, 3, width_);
     glProgramUniform1ui(programRenderShading_, 4, height_);
     glProgramUniformMatrix4fv(programRenderShading_, 5, 1, GL_FALSE, glm::value_ptr(invProjection));
     glProgramUniformMatrix4fv(programRenderShading_, 6, 1, GL_FALSE, glm::value_ptr(view));
+    glProgramUniform2f(programRenderShading_, 7,
+      static_cast<float>(renderWidth) / renderTargets_.width(), static_cast<float>(renderHeight) / renderTargets_.height());
+    glProgramUniform1i(programRenderShading_, 8, inputDepthEncoding);
 
+    glBindVertexArray(vao3_);
     glDrawElements(GL_TRIANGLES, 32, GL_UNSIGNED_INT, nullptr);
-    glEnable(GL_DEPTH_TEST);
   }
   glEndQuery(GL_TIME_ELAPSED);
+
+  stats_.frameMemoryBytes = renderTargets_.frameMemoryBytes();
+  stats_.renderTargetPoolBytes = renderTargets_.memoryBytes();
+  stats_.barriers = graph_.takeBarrierCount();
 }
 
 void Simulation::resize(std::uint32_t width, std::uint32_t height)
@@ -507,7 +1753,436 @@ const Simulation::SimulationTimes& Simulation::times() const
   return time_;
 }
 
+const Simulation::SimulationStats& Simulation::stats() const
+{
+  return stats_;
+}
+
+const Simulation::WorkGroupSizes& Simulation::workGroups() const
+{
+  return workGroups_;
+}
+
 void flut::Simulation::setIntegrationsPerFrame(std::uint32_t ipF)
 {
   integrationsPerFrame_ = ipF;
 }
+
+float flut::Simulation::timestep() const
+{
+  if (options_.adaptiveTimestep && adaptiveDt_ > 0.0f)
+  {
+    return adaptiveDt_;
+  }
+
+  return fixedTimestep();
+}
+
+float flut::Simulation::fixedTimestep() const
+{
+  const float stepDt = (options_.solverMode == 1) ? PCISPH_DT : (options_.solverMode == 2) ? PBF_DT : DT;
+  return stepDt * options_.deltaTimeMod;
+}
+
+void flut::Simulation::readTimestepStats()
+{
+  for (std::uint32_t slot = 0; slot < 2; ++slot)
+  {
+    if (!timestepFences_[slot])
+    {
+      continue;
+    }
+
+    const GLenum status = glClientWaitSync(timestepFences_[slot], 0, 0);
+
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+      continue;
+    }
+
+    // Layout as in simTimestepUpdate.comp: dt, two maxima, history index, history ring.
+    std::vector<std::uint32_t> state(TIMESTEP_BUFFER_SIZE / sizeof(std::uint32_t));
+    glGetNamedBufferSubData(bufTimestepReadback_, slot * TIMESTEP_BUFFER_SIZE, TIMESTEP_BUFFER_SIZE, state.data());
+    glDeleteSync(timestepFences_[slot]);
+    timestepFences_[slot] = nullptr;
+
+    std::memcpy(&adaptiveDt_, &state[0], sizeof(adaptiveDt_));
+    stats_.timestep = adaptiveDt_;
+
+    const std::uint32_t historyIndex = state[3];
+    const std::uint32_t historySize = std::min(historyIndex, TIMESTEP_HISTORY);
+    stats_.timestepHistory.resize(historySize);
+    for (std::uint32_t i = 0; i < historySize; ++i)
+    {
+      const std::uint32_t ringIndex = (historyIndex - historySize + i) % TIMESTEP_HISTORY;
+      std::memcpy(&stats_.timestepHistory[i], &state[4 + ringIndex], sizeof(float));
+    }
+  }
+}
+
+void flut::Simulation::readSolverStats()
+{
+  for (std::uint32_t slot = 0; slot < 2; ++slot)
+  {
+    if (!solverFences_[slot])
+    {
+      continue;
+    }
+
+    const GLenum status = glClientWaitSync(solverFences_[slot], 0, 0);
+
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+      continue;
+    }
+
+    std::uint32_t state[8];
+    glGetNamedBufferSubData(bufSolverReadback_, slot * sizeof(state), sizeof(state), state);
+    glDeleteSync(solverFences_[slot]);
+    solverFences_[slot] = nullptr;
+
+    // Layout as in the solver shaders: totalIterations at 3, lastDensityError at 4.
+    float densityError;
+    std::memcpy(&densityError, &state[4], sizeof(densityError));
+    stats_.solverIterations = static_cast<float>(state[3]) / solverReadbackSteps_[slot];
+    stats_.solverDensityError = densityError;
+  }
+}
+
+void flut::Simulation::reset()
+{
+  options_.sceneShape = std::min(std::max(options_.sceneShape, 0), 3);
+
+  // All shapes are filled at the density of the default box (the lattice the PCISPH and PBF rest
+  // density is computed from), so smaller shapes use fewer particles.
+  const float boxVolume = GRID_SIZE.x * GRID_SIZE.y * GRID_SIZE.z * 0.125f;
+  glm::vec3 shapeMin = GRID_ORIGIN + GRID_SIZE * 0.25f;
+  glm::vec3 shapeMax = GRID_ORIGIN + GRID_SIZE * 0.75f;
+  glm::vec3 velocity{0.0f};
+  float volume = boxVolume;
+
+  if (options_.sceneShape == 1)
+  {
+    // Sphere: a ball dropped from above the center.
+    const float radius = GRID_SIZE.z * 0.45f;
+    const glm::vec3 center{0.0f, GRID_SIZE.y * 0.15f, 0.0f};
+    shapeMin = center - radius;
+    shapeMax = center + radius;
+    volume = static_cast<float>(4.0 / 3.0 * M_PI * radius * radius * radius);
+  }
+  else if (options_.sceneShape == 2)
+  {
+    // Dam break: a column of the box volume against the left wall.
+    const float width = GRID_SIZE.x * 0.3f;
+    shapeMin = GRID_ORIGIN;
+    shapeMax = GRID_ORIGIN + glm::vec3{width, boxVolume / (width * GRID_SIZE.z), GRID_SIZE.z};
+  }
+  else if (options_.sceneShape == 3)
+  {
+    // Jet: a horizontal cylinder shot from the left wall towards the right.
+    const float radius = GRID_SIZE.z * 0.3f;
+    const float length = GRID_SIZE.x * 0.5f;
+    shapeMin = glm::vec3{GRID_ORIGIN.x + 0.1f, GRID_SIZE.y * 0.15f - radius, -radius};
+    shapeMax = glm::vec3{shapeMin.x + length, GRID_SIZE.y * 0.15f + radius, radius};
+    velocity = glm::vec3{6.0f, 0.0f, 0.0f};
+    volume = static_cast<float>(M_PI * radius * radius * length);
+  }
+
+  const std::uint32_t count = std::min(PARTICLE_COUNT, static_cast<std::uint32_t>(PARTICLE_COUNT * volume / boxVolume));
+
+  // Both particle buffers get the same state, so it does not matter which one is integrated next.
+  graph_.pass("Scene init").storageWrite(bufParticles1_).storageWrite(bufParticles2_).storageWrite(bufPrevPositions_).submit();
+  glUseProgram(programSimInit_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufParticles1_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufParticles2_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufPrevPositions_);
+  glProgramUniform1ui(programSimInit_, 0, count);
+  glProgramUniform1ui(programSimInit_, 1, static_cast<std::uint32_t>(options_.sceneSeed));
+  glProgramUniform1i(programSimInit_, 2, options_.sceneShape);
+  glProgramUniform3fv(programSimInit_, 3, 1, glm::value_ptr(shapeMin));
+  glProgramUniform3fv(programSimInit_, 4, 1, glm::value_ptr(shapeMax));
+  glProgramUniform3fv(programSimInit_, 5, 1, glm::value_ptr(velocity));
+  glDispatchCompute((count + workGroups_.particle - 1) / workGroups_.particle, 1, 1);
+
+  graph_.pass("Live count upload").bufferUpdate(bufLiveCount_).submit();
+  const std::uint32_t liveCount[8] = {
+    count, (count + workGroups_.particle - 1) / workGroups_.particle, 1, 1,
+    count, 1, 0, 0
+  };
+  glNamedBufferSubData(bufLiveCount_, 0, sizeof(liveCount), liveCount);
+
+  stats_.liveParticles = count;
+  stats_.staleParticleFraction = 0.0f;
+  stats_.maxCellDrift = 0;
+  binsValid_ = false;
+  accumulator_ = 0.0f;
+  emitAccumulator_ = 0.0f;
+  sleepingActive_ = false;
+}
+
+void flut::Simulation::readLiveCount()
+{
+  for (std::uint32_t slot = 0; slot < 2; ++slot)
+  {
+    if (!liveCountFences_[slot])
+    {
+      continue;
+    }
+
+    const GLenum status = glClientWaitSync(liveCountFences_[slot], 0, 0);
+
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+      continue;
+    }
+
+    // Live count, the particles outside the cells they were binned in and their largest drift.
+    std::uint32_t counts[3];
+    glGetNamedBufferSubData(bufLiveCountReadback_, slot * sizeof(counts), sizeof(counts), counts);
+    stats_.liveParticles = counts[0];
+    stats_.staleParticleFraction = (counts[0] > 0) ? static_cast<float>(counts[1]) / counts[0] : 0.0f;
+    stats_.maxCellDrift = counts[2];
+    glDeleteSync(liveCountFences_[slot]);
+    liveCountFences_[slot] = nullptr;
+  }
+}
+
+void flut::Simulation::readSmoothedDepth(std::vector<float>& depth) const
+{
+  // Only the fluid display renders into pooled targets.
+  if (texSmoothedDepth_ == 0)
+  {
+    depth.clear();
+    return;
+  }
+
+  depth.resize(stats_.renderWidth * stats_.renderHeight);
+  const GLenum format = (texSmoothedDepth_ == depthTarget_.texture) ? GL_DEPTH_COMPONENT : GL_RED;
+  glGetTextureSubImage(texSmoothedDepth_, 0, 0, 0, 0, stats_.renderWidth, stats_.renderHeight, 1,
+                       format, GL_FLOAT, depth.size() * sizeof(float), depth.data());
+
+  if (texSmoothedDepth_ == depthTarget_.texture || frameSmoothingFormat_ == DEPTH_ENCODING_WINDOW)
+  {
+    return;
+  }
+
+  // Decode back to window depth, like the shaders do.
+  constexpr float n = Camera::NEAR_PLANE;
+  constexpr float f = Camera::FAR_PLANE;
+
+  for (float& value : depth)
+  {
+    if (frameSmoothingFormat_ == DEPTH_ENCODING_COMPLEMENTARY)
+    {
+      value = 1.0f - value;
+    }
+    else if (value < 1.0f)
+    {
+      const float ndc = (f + n - 2.0f * n * f / (value * f)) / (f - n);
+      value = 0.5f * ndc + 0.5f;
+    }
+  }
+}
+
+void flut::Simulation::readColor(std::vector<float>& color) const
+{
+  if (colorTarget_.texture == 0)
+  {
+    color.clear();
+    return;
+  }
+
+  color.resize(stats_.renderWidth * stats_.renderHeight * 3);
+  glGetTextureSubImage(colorTarget_.texture, 0, 0, 0, 0, stats_.renderWidth, stats_.renderHeight, 1,
+                       GL_RGB, GL_FLOAT, color.size() * sizeof(float), color.data());
+}
+
+void flut::Simulation::updateRenderScale()
+{
+  // Render targets cover at least the window size, so the scale never exceeds one.
+  const float maxScale = std::min(std::max(options_.maxRenderScale, 0.1f), 1.0f);
+  const float minScale = std::min(std::max(options_.minRenderScale, 0.1f), maxScale);
+  float scale = maxScale;
+
+  if (options_.dynamicResolution && time_.renderMs > 0.0f)
+  {
+    // Render cost is roughly proportional to the pixel count, i.e. the squared scale.
+    const float targetScale = stats_.renderScale * std::sqrt(options_.targetRenderMs / time_.renderMs);
+    scale = stats_.renderScale + (targetScale - stats_.renderScale) * RENDER_SCALE_DAMPING;
+  }
+
+  stats_.renderScale = std::min(std::max(scale, minScale), maxScale);
+  stats_.renderWidth = std::max(1u, static_cast<std::uint32_t>(width_ * stats_.renderScale));
+  stats_.renderHeight = std::max(1u, static_cast<std::uint32_t>(height_ * stats_.renderScale));
+}
+
+void flut::Simulation::renderObstacle(const glm::mat4& mvp, const glm::mat4& view)
+{
+  if (!options_.obstacle || obstacleVertexCount_ == 0)
+  {
+    return;
+  }
+
+  glUseProgram(programRenderMesh_);
+  glProgramUniformMatrix4fv(programRenderMesh_, 0, 1, GL_FALSE, glm::value_ptr(mvp));
+  glProgramUniformMatrix4fv(programRenderMesh_, 1, 1, GL_FALSE, glm::value_ptr(view));
+  glProgramUniform3f(programRenderMesh_, 2, 0.5f, 0.5f, 0.5f);
+  glBindVertexArray(vao5_);
+  glDrawArrays(GL_TRIANGLES, 0, obstacleVertexCount_);
+}
+
+GLuint flut::Simulation::renderGeometryProgram(std::int32_t colorMode, std::int32_t shadingMode)
+{
+  colorMode = std::clamp(colorMode, 0, COLOR_MODE_COUNT - 1);
+  shadingMode = std::clamp(shadingMode, 0, POINT_SHADING_MODE_COUNT - 1);
+
+  GLuint& program = programsRenderGeometry_[shadingMode * COLOR_MODE_COUNT + colorMode];
+
+  if (program == 0)
+  {
+    // Flat points and screen-space spheres, each with the color computation of one mode.
+    const GlHelper::Defines defines = {
+      { "COLOR_MODE", std::to_string(colorMode) },
+      { "GRID_SIZE", glslVec3(GRID_SIZE) },
+      { "GRID_ORIGIN", glslVec3(GRID_ORIGIN) },
+      { "GRID_RES", glslIvec3(GRID_RES) },
+    };
+    const char* fragmentShader = (shadingMode == 0) ? RESOURCES_DIR "/renderFlat.frag" : RESOURCES_DIR "/renderGeometry.frag";
+    program = GlHelper::createVertFragShader(RESOURCES_DIR "/renderGeometry.vert", fragmentShader, defines);
+  }
+
+  return program;
+}
+
+void flut::Simulation::extractSurface()
+{
+  // Reset the counters, which double as indirect draw (0-3) and dispatch (5-7) arguments.
+  graph_.pass("Mesh counter reset").bufferUpdate(bufMeshCounters_).submit();
+  const std::uint32_t meshCounters[8] = { 0, 1, 0, 0, 0, 0, 1, 1 };
+  glNamedBufferSubData(bufMeshCounters_, 0, sizeof(meshCounters), meshCounters);
+
+  // The grid only holds particle offsets once the first step has sorted the particles.
+  if (stepCount_ == 0)
+  {
+    return;
+  }
+
+  const glm::vec3 invCellSize = INV_CELL_SIZE;
+
+  // Step 1: Gather particle density into the field, using the sorted particles and grid of the last step.
+  const GLuint sortedParticles = swapFrame_ ? bufParticles1_ : bufParticles2_;
+  graph_.pass("Mesh density").storageRead(sortedParticles).imageRead(texGrid_).imageWrite(texMeshField_).submit();
+  glUseProgram(programMeshDensity_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortedParticles);
+  GlHelper::setImageUniform(programMeshDensity_, 0, texGridImgHandle_);
+  GlHelper::setImageUniform(programMeshDensity_, 1, texMeshFieldImgHandle_);
+  glProgramUniform3fv(programMeshDensity_, 2, 1, glm::value_ptr(invCellSize));
+  glProgramUniform3fv(programMeshDensity_, 3, 1, glm::value_ptr(GRID_ORIGIN));
+  glProgramUniform3iv(programMeshDensity_, 4, 1, glm::value_ptr(GRID_RES));
+  glProgramUniform3iv(programMeshDensity_, 5, 1, glm::value_ptr(MESH_FIELD_RES));
+  glProgramUniform1f(programMeshDensity_, 6, MESH_CELL_SIZE);
+  glProgramUniform1f(programMeshDensity_, 7, KERNEL_RADIUS);
+  glDispatchCompute(
+    (MESH_FIELD_RES.x + 4 - 1) / 4,
+    (MESH_FIELD_RES.y + 4 - 1) / 4,
+    (MESH_FIELD_RES.z + 4 - 1) / 4
+  );
+
+  // Step 2: Classify voxels, append the ones intersecting the surface and reserve their vertices.
+  graph_.pass("Mesh classify")
+    .storageWrite(bufMeshCounters_)
+    .storageWrite(bufMeshActiveVoxels_)
+    .storageRead(bufMeshTables_)
+    .textureRead(texMeshField_)
+    .submit();
+  glUseProgram(programMeshClassify_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufMeshCounters_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufMeshActiveVoxels_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufMeshTables_);
+  GlHelper::setTextureUniform(programMeshClassify_, 0, texMeshFieldHandle_);
+  glProgramUniform3iv(programMeshClassify_, 1, 1, glm::value_ptr(MESH_FIELD_RES));
+  glProgramUniform1f(programMeshClassify_, 2, options_.meshIsoValue);
+  glProgramUniform1ui(programMeshClassify_, 3, MESH_MAX_VERTICES);
+  glDispatchCompute(
+    (MESH_FIELD_RES.x - 1 + 4 - 1) / 4,
+    (MESH_FIELD_RES.y - 1 + 4 - 1) / 4,
+    (MESH_FIELD_RES.z - 1 + 4 - 1) / 4
+  );
+
+  // Step 3: Write the indirect arguments.
+  graph_.pass("Mesh arguments").storageWrite(bufMeshCounters_).submit();
+  glUseProgram(programMeshArgs_);
+  glProgramUniform1ui(programMeshArgs_, 0, MESH_MAX_VERTICES);
+  glProgramUniform1ui(programMeshArgs_, 1, MESH_GROUP_SIZE);
+  glDispatchCompute(1, 1, 1);
+
+  // Step 4: Generate the triangles of the active voxels only.
+  graph_.pass("Mesh generate")
+    .storageRead(bufMeshCounters_)
+    .indirectRead(bufMeshCounters_)
+    .storageRead(bufMeshActiveVoxels_)
+    .storageRead(bufMeshTables_)
+    .storageWrite(bufMeshVertices_)
+    .textureRead(texMeshField_)
+    .submit();
+  glUseProgram(programMeshGenerate_);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, bufMeshVertices_);
+  GlHelper::setTextureUniform(programMeshGenerate_, 0, texMeshFieldHandle_);
+  glProgramUniform3iv(programMeshGenerate_, 1, 1, glm::value_ptr(MESH_FIELD_RES));
+  glProgramUniform1f(programMeshGenerate_, 2, options_.meshIsoValue);
+  glProgramUniform3fv(programMeshGenerate_, 3, 1, glm::value_ptr(GRID_ORIGIN));
+  glProgramUniform1f(programMeshGenerate_, 4, MESH_CELL_SIZE);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, bufMeshCounters_);
+  glDispatchComputeIndirect(5 * sizeof(std::uint32_t));
+}
+
+std::uint32_t flut::Simulation::meshTriangleCount()
+{
+  // The vertex count of the last extraction doubles as the indirect draw count.
+  graph_.pass("Mesh count readback").bufferUpdate(bufMeshCounters_).submit();
+  std::uint32_t vertexCount = 0;
+  glGetNamedBufferSubData(bufMeshCounters_, 0, sizeof(vertexCount), &vertexCount);
+
+  return vertexCount / 3;
+}
+
+std::uint32_t flut::Simulation::exportMesh(const std::string& path)
+{
+  std::ofstream file(path);
+
+  if (!file)
+  {
+    throw std::runtime_error("Unable to open file " + path);
+  }
+
+  extractSurface();
+
+  graph_.pass("Mesh readback").bufferUpdate(bufMeshCounters_).bufferUpdate(bufMeshVertices_).submit();
+  std::uint32_t vertexCount = 0;
+  glGetNamedBufferSubData(bufMeshCounters_, 0, sizeof(vertexCount), &vertexCount);
+
+  std::vector<glm::vec4> vertices(vertexCount * 2);
+  glGetNamedBufferSubData(bufMeshVertices_, 0, vertices.size() * sizeof(glm::vec4), vertices.data());
+
+  // Vertices are not shared between triangles, so the faces simply index them in order.
+  file << "# flut surface mesh, iso value " << options_.meshIsoValue << "\n";
+
+  for (std::uint32_t i = 0; i < vertexCount; ++i)
+  {
+    const glm::vec4& p = vertices[i * 2];
+    file << "v " << p.x << " " << p.y << " " << p.z << "\n";
+  }
+
+  for (std::uint32_t i = 0; i < vertexCount; ++i)
+  {
+    const glm::vec4& n = vertices[i * 2 + 1];
+    file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+  }
+
+  for (std::uint32_t i = 1; i + 2 <= vertexCount; i += 3)
+  {
+    file << "f " << i << "//" << i << " " << i + 1 << "//" << i + 1 << " " << i + 2 << "//" << i + 2 << "\n";
+  }
+
+  return vertexCount / 3;
+}
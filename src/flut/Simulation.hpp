@@ -2,9 +2,14 @@
 
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include <array>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #include "Camera.hpp"
+#include "RenderGraph.hpp"
+#include "RenderTargetPool.hpp"
 
 namespace flut
 {
@@ -17,6 +22,33 @@ namespace flut
       float deltaTimeMod = 1.0f;
       std::int32_t colorMode = 0;
       std::int32_t shadingMode = 1;
+      std::int32_t smoothingMode = 1;
+      bool dynamicResolution = false;
+      float targetRenderMs = 8.0f;
+      float minRenderScale = 0.5f;
+      float maxRenderScale = 1.0f;
+      float meshIsoValue = 0.6f;
+      std::int32_t colorFormat = 0;
+      std::int32_t smoothingFormat = 0;
+      bool obstacle = false;
+      std::int32_t solverMode = 0;
+      float pcisphTolerance = 0.01f;
+      std::int32_t pbfIterations = 4;
+      bool adaptiveTimestep = false;
+      float cflNumber = 0.4f;
+      bool sleeping = false;
+      bool subgroupAtomics = true;
+      std::int32_t sortMode = 0;
+      bool incrementalSort = false;
+      std::int32_t resortInterval = 8;
+      float resortThreshold = 0.02f;
+      bool rowRanges = true;
+      float sleepSpeed = 0.05f;
+      bool emitter = false;
+      float emitterSpeed = 4.0f;
+      bool sink = false;
+      std::int32_t sceneShape = 0;
+      std::int32_t sceneSeed = 1;
     };
 
     struct SimulationTimes
@@ -27,9 +59,41 @@ namespace flut
       float simStep4Ms = 0.0f;
       float simStep5Ms = 0.0f;
       float simStep6Ms = 0.0f;
+      float renderGeometryMs = 0.0f;
+      float renderSmoothMs = 0.0f;
+      float renderShadingMs = 0.0f;
       float renderMs = 0.0f;
     };
 
+    struct SimulationStats
+    {
+      float renderScale = 1.0f;
+      std::uint32_t renderWidth = 0;
+      std::uint32_t renderHeight = 0;
+      std::uint32_t substeps = 0;
+      float simulationSpeed = 0.0f;
+      std::uint64_t frameMemoryBytes = 0;
+      std::uint64_t renderTargetPoolBytes = 0;
+      float solverIterations = 0.0f;
+      float solverDensityError = 0.0f;
+      float timestep = 0.0f;
+      std::vector<float> timestepHistory;
+      std::uint32_t liveParticles = 0;
+      std::uint32_t barriers = 0;
+      bool subgroupAtomicsSupported = false;
+      float staleParticleFraction = 0.0f;
+      std::uint32_t maxCellDrift = 0;
+      float sortSavedFraction = 0.0f;
+    };
+
+    // Work group sizes of the particle kernels (steps 1, 3, 5, 6 and the PCISPH and PBF solvers)
+    // and of the grid kernels (steps 2 and 4), compiled into the shaders.
+    struct WorkGroupSizes
+    {
+      std::uint32_t particle = 32;
+      glm::ivec3 grid = glm::ivec3{4, 4, 4};
+    };
+
   public:
     constexpr static float DT = 0.0012f;
     constexpr static float STIFFNESS = 250.0;
@@ -41,18 +105,61 @@ namespace flut
     constexpr static float REST_DENSITY = 998.27f;
     constexpr static float REST_PRESSURE = 0.0f;
     constexpr static std::uint32_t PARTICLE_COUNT = 50000;
+    constexpr static float PCISPH_DT = DT * 5.0f;
+    constexpr static float PBF_DT = DT * 7.0f;
+    constexpr static std::uint32_t TIMESTEP_HISTORY = 128;
 
     const glm::vec3 GRID_SIZE = glm::vec3{ 10.0f, 6.0f, 2.0f } * glm::vec3{ 2.0f };
     const glm::vec3 GRID_ORIGIN = GRID_SIZE * -0.5f;
     const glm::ivec3 GRID_RES = glm::ivec3((GRID_SIZE / CELL_SIZE) + 1.0f);
     const std::uint32_t GRID_VOXEL_COUNT = GRID_RES.x * GRID_RES.y * GRID_RES.z;
+    const glm::vec3 INV_CELL_SIZE = glm::vec3(GRID_RES) * (1.0f - 0.001f) / GRID_SIZE;
+
+    constexpr static float MESH_CELL_SIZE = CELL_SIZE * 0.5f;
+    const glm::ivec3 MESH_FIELD_RES = glm::ivec3((GRID_SIZE / MESH_CELL_SIZE) + 1.0f);
+
+    constexpr static float SDF_CELL_SIZE = CELL_SIZE * 0.5f;
+    const glm::ivec3 SDF_RES = glm::ivec3(glm::ceil(GRID_SIZE / SDF_CELL_SIZE));
 
   private:
     constexpr static std::uint32_t SMOOTH_ITERATIONS = 30;
+    constexpr static std::uint32_t SMOOTH_ITERATIONS_PER_DISPATCH = 6;
+    constexpr static std::uint32_t SMOOTH_TILE_SIZE = 16;
+    constexpr static std::uint32_t SMOOTH_FILTER_ITERATIONS = 2;
+    constexpr static std::uint32_t TIMER_QUERY_COUNT = 9;
+    constexpr static std::uint32_t RADIX_BITS = 4;
+    constexpr static std::int32_t COLOR_MODE_COUNT = 5;
+    constexpr static std::int32_t POINT_SHADING_MODE_COUNT = 2;
+    constexpr static std::uint32_t RENDER_TARGET_GRANULARITY = 256;
+    constexpr static std::uint32_t RENDER_TARGET_UNUSED_FRAMES = 120;
+    constexpr static float RENDER_SCALE_DAMPING = 0.2f;
+    constexpr static float SIMULATION_SPEED_DAMPING = 0.05f;
+    constexpr static float SORT_COST_DAMPING = 0.05f;
+    constexpr static std::uint32_t MAX_CELL_DRIFT = 1;
+    constexpr static std::uint32_t MESH_MAX_VERTICES = 1 << 20;
+    constexpr static std::uint32_t MESH_GROUP_SIZE = 64;
+    constexpr static std::uint32_t PCISPH_MIN_ITERATIONS = 3;
+    constexpr static std::uint32_t PCISPH_MAX_ITERATIONS = 30;
+    constexpr static float PBF_RELAXATION = 1.0f;
+    constexpr static float PBF_TENSILE_STRENGTH = 0.1f;
+    constexpr static float PBF_TENSILE_DISTANCE = 0.2f;
+    constexpr static float PBF_VISCOSITY = 0.01f;
+    constexpr static float ADAPTIVE_DT_MIN_SCALE = 0.25f;
+    constexpr static float ADAPTIVE_DT_MAX_SCALE = 4.0f;
+    constexpr static std::uint32_t SLEEP_STEPS = 60;
+    constexpr static float SLEEP_DENSITY_CHANGE = 0.001f;
+    constexpr static std::uint32_t TIMESTEP_BUFFER_SIZE = (4 + TIMESTEP_HISTORY) * sizeof(std::uint32_t);
+    constexpr static float EMITTER_RADIUS = 0.4f;
+    const glm::vec3 EMITTER_POSITION = glm::vec3{ -8.0f, 3.0f, 0.0f };
+    const glm::vec3 EMITTER_DIRECTION = glm::normalize(glm::vec3{ 1.0f, -0.5f, 0.0f });
+    const glm::vec3 SINK_MIN = glm::vec3{ 8.5f, -6.0f, -2.0f };
+    const glm::vec3 SINK_MAX = glm::vec3{ 10.0f, -4.5f, 2.0f };
 
   public:
     Simulation(std::uint32_t width, std::uint32_t height);
 
+    Simulation(std::uint32_t width, std::uint32_t height, const WorkGroupSizes& workGroups);
+
     ~Simulation();
 
   public:
@@ -64,60 +171,179 @@ namespace flut
 
     const SimulationTimes& times() const;
 
+    const SimulationStats& stats() const;
+
+    const WorkGroupSizes& workGroups() const;
+
     void setIntegrationsPerFrame(std::uint32_t ipF);
 
+    // Refills the particles on the GPU with the scene shape and seed from the options.
+    void reset();
+
+    float timestep() const;
+
+    void readSmoothedDepth(std::vector<float>& depth) const;
+
+    void readColor(std::vector<float>& color) const;
+
+    std::uint32_t meshTriangleCount();
+
+    std::uint32_t exportMesh(const std::string& path);
+
   private:
-    void createFrameObjects();
+    void updateRenderScale();
+
+    void extractSurface();
+
+    void renderObstacle(const glm::mat4& mvp, const glm::mat4& view);
+
+    GLuint renderGeometryProgram(std::int32_t colorMode, std::int32_t shadingMode);
+
+    void readSolverStats();
+
+    void readTimestepStats();
+
+    void readLiveCount();
 
-    void deleteFrameObjects();
+    float fixedTimestep() const;
 
   private:
     std::uint32_t width_;
     std::uint32_t height_;
     std::uint32_t newWidth_;
     std::uint32_t newHeight_;
+    std::int32_t frameColorFormat_;
+    std::int32_t frameSmoothingFormat_;
     std::uint64_t frame_;
     SimulationTimes time_;
+    SimulationStats stats_;
     SimulationOptions options_;
+    WorkGroupSizes workGroups_;
     std::uint32_t integrationsPerFrame_;
+    std::uint64_t stepCount_;
+    float accumulator_;
     float weightConstViscosity_;
     float weightConstPressure_;
     float weightConstKernel_;
-    GLuint timerQueries_[2][7];
+    float latticeRestDensity_;
+    float pcisphGradientSum_;
+    GLuint timerQueries_[2][TIMER_QUERY_COUNT];
     GLuint programSimStep1_;
     GLuint programSimStep2_;
     GLuint programSimStep3_;
     GLuint programSimStep4_;
-    GLuint programSimStep5_;
-    GLuint programSimStep6_;
-    GLuint programRenderGeometry_;
-    GLuint programRenderFlat_;
+    GLuint programSimStep1Subgroup_;
+    GLuint programSimStep2Subgroup_;
+    GLuint programSimStep3Subgroup_;
+    GLuint programRadixHistogram_;
+    GLuint programRadixScan_;
+    GLuint programRadixScatter_;
+    GLuint programRadixRanges_;
+    std::array<GLuint, 4> programsSimStep5_;
+    std::array<GLuint, 4> programsSimStep6_;
+    GLuint programPcisphInit_;
+    GLuint programPcisphPredict_;
+    GLuint programPcisphDensity_;
+    GLuint programPcisphCheck_;
+    GLuint programPcisphPressure_;
+    GLuint programPcisphApply_;
+    GLuint programPbfInit_;
+    GLuint programPbfLambda_;
+    GLuint programPbfDelta_;
+    GLuint programPbfVelocity_;
+    GLuint programPbfViscosity_;
+    GLuint programSimTimestep_;
+    GLuint programSimTimestepUpdate_;
+    GLuint programSimSleep_;
+    GLuint programSimEmit_;
+    GLuint programSimLiveCount_;
+    GLuint programSimInit_;
+    std::array<GLuint, COLOR_MODE_COUNT * POINT_SHADING_MODE_COUNT> programsRenderGeometry_;
     GLuint programRenderCurvature_;
+    GLuint programRenderCurvatureTiled_;
+    GLuint programRenderBilateral_;
     GLuint programRenderShading_;
+    GLuint programRenderMesh_;
+    GLuint programMeshDensity_;
+    GLuint programMeshClassify_;
+    GLuint programMeshArgs_;
+    GLuint programMeshGenerate_;
     GLuint bufBBoxVertices_;
     GLuint bufBBoxIndices_;
     GLuint bufParticles1_;
     GLuint bufParticles2_;
+    GLuint bufPrevPositions_;
     GLuint bufCounters_;
+    GLuint bufCellKeys_;
+    GLuint bufSortedCellKeys_;
+    GLuint bufRadixKeys_[2];
+    GLuint bufRadixValues_[2];
+    GLuint bufRadixHistogram_;
+    GLuint bufOccupancy_;
+    GLuint bufBrickOccupancy_;
+    GLuint bufVelocityBricks_;
+    GLuint bufPredictedPositions_;
+    GLuint bufAccelNonPressure_;
+    GLuint bufAccelPressure_;
+    GLuint bufPbfPositions1_;
+    GLuint bufPbfPositions2_;
+    GLuint bufSolverState_;
+    GLuint bufSolverReadback_;
+    GLsync solverFences_[2];
+    std::uint32_t solverReadbackSteps_[2];
+    GLuint bufTimestep_;
+    GLuint bufTimestepReadback_;
+    GLuint bufAccelerations_;
+    GLsync timestepFences_[2];
+    float adaptiveDt_;
+    bool sleepingActive_;
+    std::uint32_t radixPasses_;
+    bool binsValid_;
+    bool lastStepSorted_;
+    std::uint32_t stepsSinceSort_;
+    float fullStepMs_;
+    float incrementalStepMs_;
+    GLuint bufActiveCells_;
+    GLuint bufSleepArgs_;
+    GLuint bufLiveCount_;
+    GLuint bufLiveCountReadback_;
+    GLsync liveCountFences_[2];
+    float emitAccumulator_;
     GLuint texGrid_;
     GLuint64 texGridImgHandle_;
     GLuint texVelocity_;
     GLuint64 texVelocityHandle_;
     GLuint64 texVelocityImgHandle_;
+    GLuint texCellMotion_;
+    GLuint64 texCellMotionImgHandle_;
+    GLuint texCellQuietSteps_;
+    GLuint64 texCellQuietStepsImgHandle_;
+    GLuint texMeshField_;
+    GLuint64 texMeshFieldHandle_;
+    GLuint64 texMeshFieldImgHandle_;
+    GLuint bufMeshCounters_;
+    GLuint bufMeshActiveVoxels_;
+    GLuint bufMeshTables_;
+    GLuint bufMeshVertices_;
+    GLuint bufObstacleVertices_;
+    std::uint32_t obstacleVertexCount_;
+    GLuint texObstacleSdf_;
+    GLuint64 texObstacleSdfHandle_;
     GLuint vao1_;
     GLuint vao2_;
     GLuint vao3_;
+    GLuint vao4_;
+    GLuint vao5_;
     GLuint fbo1_;
     GLuint fbo2_;
     GLuint fbo3_;
-    GLuint texDepth_;
-    GLuint64 texDepthHandle_;
-    GLuint texColor_;
-    GLuint64 texColorHandle_;
-    GLuint texTemp1_;
-    GLuint64 texTemp1Handle_;
-    GLuint texTemp2_;
-    GLuint64 texTemp2Handle_;
+    RenderGraph graph_;
+    RenderTargetPool renderTargets_;
+    RenderTargetPool::Target depthTarget_;
+    RenderTargetPool::Target colorTarget_;
+    RenderTargetPool::Target smoothTargets_[2];
+    GLuint texSmoothedDepth_;
     bool swapFrame_;
+    bool swapQueries_;
   };
 }
@@ -1,14 +1,16 @@
 #include "Window.hpp"
+#include "GlHelper.hpp"
 
 #include <imgui.h>
 #include <imgui_impl_sdl_glad.h>
 #include <glad/glad.h>
 #include <stdexcept>
 #include <cstdio>
+#include <string>
 
 using namespace flut;
 
-Window::Window(const char* title, std::uint32_t width, std::uint32_t height)
+Window::Window(const char* title, std::uint32_t width, std::uint32_t height, bool bindless)
   : shouldClose_{false}
 {
   if (SDL_InitSubSystem(SDL_INIT_VIDEO)) {
@@ -39,6 +41,12 @@ Window::Window(const char* title, std::uint32_t width, std::uint32_t height)
 
   context_ = SDL_GL_CreateContext(window_);
 
+  // Software rasterizers like llvmpipe may stop at OpenGL 4.5.
+  if (!context_) {
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+    context_ = SDL_GL_CreateContext(window_);
+  }
+
   if (!context_) {
     throw std::runtime_error(SDL_GetError());
   }
@@ -51,15 +59,25 @@ Window::Window(const char* title, std::uint32_t width, std::uint32_t height)
     throw std::runtime_error("Unable to initialize Glad.");
   }
 
-  if (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 6)) {
-    throw std::runtime_error("OpenGL 4.6 required.");
+  if (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 5)) {
+    throw std::runtime_error("OpenGL 4.5 required.");
   }
 
-  if (!GLAD_GL_ARB_bindless_texture) {
-    throw std::runtime_error("GL_ARB_bindless_texture extension is required.");
+  const bool useBindless = bindless && GLAD_GL_ARB_bindless_texture;
+
+  if (!useBindless) {
+    GLint imageUnits = 0;
+    glGetIntegerv(GL_MAX_IMAGE_UNITS, &imageUnits);
+
+    if (imageUnits < GlHelper::CLASSIC_IMAGE_UNITS) {
+      throw std::runtime_error("GL_ARB_bindless_texture or " + std::to_string(GlHelper::CLASSIC_IMAGE_UNITS) + " image units required.");
+    }
   }
 
-  std::printf("OpenGL Version %d.%d loaded.\n", GLVersion.major, GLVersion.minor);
+  GlHelper::setBindless(useBindless);
+
+  std::printf("OpenGL Version %d.%d loaded (%s textures).\n", GLVersion.major, GLVersion.minor,
+              useBindless ? "bindless" : "bound");
 
   ImGui_ImplSdlGlad_Init(window_);
   ImGui_ImplSdlGlad_NewFrame(window_);
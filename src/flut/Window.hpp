@@ -9,7 +9,8 @@ namespace flut
   class Window
   {
   public:
-    Window(const char* title, std::uint32_t width, std::uint32_t height);
+    // Bindless textures are used if requested and supported, classic units otherwise.
+    Window(const char* title, std::uint32_t width, std::uint32_t height, bool bindless = true);
 
     ~Window();
 
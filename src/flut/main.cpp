@@ -3,26 +3,690 @@
 #include "Window.hpp"
 
 #include <imgui.h>
+#include <algorithm>
+#include <cfloat>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
+namespace
+{
+  constexpr std::uint32_t BENCHMARK_WARMUP_FRAMES = 300;
+  constexpr std::uint32_t BENCHMARK_SETTLE_FRAMES = 3;
+  constexpr std::uint32_t BENCHMARK_FRAMES = 120;
+  constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+
+  constexpr std::uint32_t TUNE_WARMUP_FRAMES = 200;
+  constexpr std::uint32_t TUNE_FRAMES = 120;
+  constexpr std::uint32_t TUNE_INTEGRATIONS = 5;
+
+  const char* MESH_EXPORT_PATH = "flut_mesh.obj";
+  const char* WORK_GROUP_CACHE_PATH = "flut_workgroups.txt";
+  const std::uint32_t PARTICLE_GROUP_CANDIDATES[] = { 32, 64, 128, 256 };
+  const glm::ivec3 GRID_GROUP_CANDIDATES[] = { {4, 4, 4}, {8, 4, 2}, {8, 8, 1}, {8, 4, 4}, {8, 8, 4} };
+  const char* SMOOTHING_MODE_NAMES[] = { "Curvature Flow", "Curvature Flow (Tiled)", "Narrow-Range Filter" };
+  const char* SOLVER_MODE_NAMES[] = { "SPH", "PCISPH", "PBF" };
+  const char* SORT_MODE_NAMES[] = { "Counting Sort", "Radix Sort" };
+  const char* SCENE_SHAPE_NAMES[] = { "Box", "Sphere", "Dam", "Jet" };
+  const char* COLOR_FORMAT_NAMES[] = { "Color RGB32F", "Color RGBA8", "Color R11G11B10F" };
+  const char* SMOOTHING_FORMAT_NAMES[] = { "Smoothing R32F", "Smoothing R16F (1 - z)", "Smoothing R16 (linear)" };
+
+  struct FormatTimes
+  {
+    float geometryMs = 0.0f;
+    float smoothMs = 0.0f;
+    float shadingMs = 0.0f;
+  };
+
+  void benchmarkFrame(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    window.pollEvents();
+    simulation.render(camera, BENCHMARK_FRAME_TIME);
+    window.swap();
+  }
+
+  // Mean absolute difference in linear eye depth over pixels covered in both images.
+  float depthDeviation(const std::vector<float>& a, const std::vector<float>& b, const glm::mat4& projection)
+  {
+    double sum = 0.0;
+    std::uint64_t count = 0;
+
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+      if (a[i] >= 1.0f || b[i] >= 1.0f)
+      {
+        continue;
+      }
+      const float eyeA = projection[3][2] / ((2.0f * a[i] - 1.0f) + projection[2][2]);
+      const float eyeB = projection[3][2] / ((2.0f * b[i] - 1.0f) + projection[2][2]);
+      sum += std::abs(eyeA - eyeB);
+      ++count;
+    }
+
+    return count ? static_cast<float>(sum / count) : 0.0f;
+  }
+
+  // Mean absolute difference over all color components.
+  float colorDeviation(const std::vector<float>& a, const std::vector<float>& b)
+  {
+    double sum = 0.0;
+
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+      sum += std::abs(a[i] - b[i]);
+    }
+
+    return a.empty() ? 0.0f : static_cast<float>(sum / a.size());
+  }
+
+  // Renders the same (frozen) particle state with every smoothing mode and reports
+  // cost and the deviation from the reference curvature flow result.
+  void runSmoothingBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const auto& times = simulation.times();
+    const std::int32_t modeCount = sizeof(SMOOTHING_MODE_NAMES) / sizeof(SMOOTHING_MODE_NAMES[0]);
+
+    options.shadingMode = 1;
+    simulation.setIntegrationsPerFrame(0);
+
+    std::vector<float> referenceDepth;
+    std::vector<float> depth;
+
+    std::printf("%-24s %12s %12s %16s\n", "Smoothing", "Smooth (ms)", "Render (ms)", "Depth error");
+
+    for (std::int32_t mode = 0; mode < modeCount; ++mode)
+    {
+      options.smoothingMode = mode;
+
+      for (std::uint32_t i = 0; i < BENCHMARK_SETTLE_FRAMES; ++i)
+      {
+        benchmarkFrame(window, camera, simulation);
+      }
+
+      float smoothMs = 0.0f;
+      float renderMs = 0.0f;
+
+      for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+      {
+        benchmarkFrame(window, camera, simulation);
+        smoothMs += times.renderSmoothMs;
+        renderMs += times.renderMs;
+      }
+
+      simulation.readSmoothedDepth(mode == 0 ? referenceDepth : depth);
+      const float error = (mode == 0) ? 0.0f : depthDeviation(referenceDepth, depth, camera.projection());
+
+      std::printf("%-24s %12.3f %12.3f %16.6f\n", SMOOTHING_MODE_NAMES[mode],
+                  smoothMs / BENCHMARK_FRAMES, renderMs / BENCHMARK_FRAMES, error);
+    }
+  }
+
+  FormatTimes measureFormatTimes(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    const auto& times = simulation.times();
+    FormatTimes result;
+
+    for (std::uint32_t i = 0; i < BENCHMARK_SETTLE_FRAMES; ++i)
+    {
+      benchmarkFrame(window, camera, simulation);
+    }
+
+    for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+    {
+      benchmarkFrame(window, camera, simulation);
+      result.geometryMs += times.renderGeometryMs / BENCHMARK_FRAMES;
+      result.smoothMs += times.renderSmoothMs / BENCHMARK_FRAMES;
+      result.shadingMs += times.renderShadingMs / BENCHMARK_FRAMES;
+    }
+
+    return result;
+  }
+
+  void printFormatRow(const char* name, const flut::Simulation& simulation,
+                      const FormatTimes& result, const FormatTimes& reference, float error)
+  {
+    std::printf("%-24s %12.2f %8.3f (%+.3f) %8.3f (%+.3f) %8.3f (%+.3f) %12.6f\n", name,
+                simulation.stats().frameMemoryBytes / (1024.0 * 1024.0),
+                result.geometryMs, result.geometryMs - reference.geometryMs,
+                result.smoothMs, result.smoothMs - reference.smoothMs,
+                result.shadingMs, result.shadingMs - reference.shadingMs, error);
+  }
+
+  // Renders the same (frozen) particle state with every render target format and reports the
+  // frame object memory, the per-pass cost relative to the 32 bit formats and the deviation
+  // from their color and smoothed depth.
+  void runFormatBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const std::int32_t colorFormatCount = sizeof(COLOR_FORMAT_NAMES) / sizeof(COLOR_FORMAT_NAMES[0]);
+    const std::int32_t smoothingFormatCount = sizeof(SMOOTHING_FORMAT_NAMES) / sizeof(SMOOTHING_FORMAT_NAMES[0]);
+
+    options.shadingMode = 1;
+    options.colorFormat = 0;
+    options.smoothingFormat = 0;
+    simulation.setIntegrationsPerFrame(0);
+
+    std::vector<float> referenceColor;
+    std::vector<float> referenceDepth;
+    std::vector<float> data;
+
+    std::printf("%-24s %12s %19s %19s %19s %12s\n", "Format", "Memory (MB)", "Geometry (ms)", "Smoothing (ms)", "Shading (ms)", "Error");
+
+    const FormatTimes reference = measureFormatTimes(window, camera, simulation);
+    simulation.readColor(referenceColor);
+    simulation.readSmoothedDepth(referenceDepth);
+    printFormatRow(COLOR_FORMAT_NAMES[0], simulation, reference, reference, 0.0f);
+
+    for (std::int32_t format = 1; format < colorFormatCount; ++format)
+    {
+      options.colorFormat = format;
+      const FormatTimes result = measureFormatTimes(window, camera, simulation);
+      simulation.readColor(data);
+      printFormatRow(COLOR_FORMAT_NAMES[format], simulation, result, reference, colorDeviation(referenceColor, data));
+    }
+
+    options.colorFormat = 0;
+
+    for (std::int32_t format = 1; format < smoothingFormatCount; ++format)
+    {
+      options.smoothingFormat = format;
+      const FormatTimes result = measureFormatTimes(window, camera, simulation);
+      simulation.readSmoothedDepth(data);
+      printFormatRow(SMOOTHING_FORMAT_NAMES[format], simulation, result, reference,
+                     depthDeviation(referenceDepth, data, camera.projection()));
+    }
+
+    options.smoothingFormat = 0;
+  }
+
+  // Runs every solver with the same integration budget, with the fixed and the adaptive timestep,
+  // and reports the timesteps taken, the cost per step and the throughput in simulated seconds
+  // per second (GPU time of the simulation steps, and wall clock).
+  void runSolverBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const auto& times = simulation.times();
+    const auto& stats = simulation.stats();
+    const std::int32_t solverCount = sizeof(SOLVER_MODE_NAMES) / sizeof(SOLVER_MODE_NAMES[0]);
+    constexpr std::uint32_t integrations = 5;
+
+    std::printf("%-24s %12s %12s %12s %12s %12s %16s %16s\n", "Solver", "Timestep", "Min dt", "Max dt",
+                "Iterations", "Step (ms)", "Sim s / GPU s", "Sim s / wall s");
+
+    for (std::int32_t mode = 0; mode < solverCount; ++mode)
+    {
+      for (const bool adaptive : { false, true })
+      {
+        options.solverMode = mode;
+        options.adaptiveTimestep = adaptive;
+        simulation.setIntegrationsPerFrame(integrations);
+        simulation.reset();
+
+        for (std::uint32_t i = 0; i < BENCHMARK_SETTLE_FRAMES; ++i)
+        {
+          simulation.render(camera, simulation.timestep() * integrations);
+          window.swap();
+        }
+
+        float gpuMs = 0.0f;
+        float simulatedTime = 0.0f;
+        float iterations = 0.0f;
+        std::uint32_t steps = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+        {
+          window.pollEvents();
+          simulation.render(camera, simulation.timestep() * integrations);
+          window.swap();
+          gpuMs += times.simStep1Ms + times.simStep2Ms + times.simStep3Ms +
+                   times.simStep4Ms + times.simStep5Ms + times.simStep6Ms;
+          simulatedTime += stats.timestep * stats.substeps;
+          steps += stats.substeps;
+          iterations += stats.solverIterations;
+        }
+
+        const std::chrono::duration<float> wallTime{std::chrono::high_resolution_clock::now() - start};
+        const float stepMs = (steps > 0) ? gpuMs / steps : 0.0f;
+        const auto& history = stats.timestepHistory;
+        const bool hasHistory = adaptive && !history.empty();
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s%s", SOLVER_MODE_NAMES[mode], adaptive ? " (adaptive)" : "");
+        std::printf("%-24s %12.4f %12.4f %12.4f %12.1f %12.3f %16.2f %16.2f\n", name,
+                    (steps > 0) ? simulatedTime / steps : 0.0f,
+                    hasHistory ? *std::min_element(history.begin(), history.end()) : stats.timestep,
+                    hasHistory ? *std::max_element(history.begin(), history.end()) : stats.timestep,
+                    mode == 0 ? 1.0f : iterations / BENCHMARK_FRAMES, stepMs,
+                    gpuMs > 0.0f ? simulatedTime / (gpuMs / 1000.0f) : 0.0f,
+                    simulatedTime / wallTime.count());
+      }
+    }
+
+    options.solverMode = 0;
+    options.adaptiveTimestep = false;
+  }
+
+  // Compares the binning paths on every scene shape, each with a full sort every step and with
+  // incremental steps, and reports the share of the step cost (steps 1 to 6, as the incremental
+  // steps widen the neighbor search) they saved. The particle count is fixed, the shapes differ
+  // in how densely the particles populate the grid cells.
+  void runSortBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const auto& times = simulation.times();
+    const auto& stats = simulation.stats();
+    const std::int32_t sortCount = sizeof(SORT_MODE_NAMES) / sizeof(SORT_MODE_NAMES[0]);
+    const std::int32_t shapeCount = sizeof(SCENE_SHAPE_NAMES) / sizeof(SCENE_SHAPE_NAMES[0]);
+    constexpr std::uint32_t settleFrames = 60;
+
+    std::printf("%-28s %-12s %12s %12s %12s\n", "Sort", "Scene", "Steps (ms)", "Particles", "Saved");
+
+    for (std::int32_t mode = 0; mode < sortCount; ++mode)
+    {
+      for (std::int32_t shape = 0; shape < shapeCount; ++shape)
+      {
+        float fullSortMs = 0.0f;
+
+        for (const bool incremental : { false, true })
+        {
+          options.sortMode = mode;
+          options.sceneShape = shape;
+          options.incrementalSort = incremental;
+          simulation.reset();
+
+          for (std::uint32_t i = 0; i < settleFrames; ++i)
+          {
+            benchmarkFrame(window, camera, simulation);
+          }
+
+          float simulationMs = 0.0f;
+          std::uint32_t steps = 0;
+
+          for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+          {
+            benchmarkFrame(window, camera, simulation);
+            simulationMs += times.simStep1Ms + times.simStep2Ms + times.simStep3Ms + times.simStep4Ms +
+                            times.simStep5Ms + times.simStep6Ms;
+            steps += stats.substeps;
+          }
+
+          const float stepMs = (steps > 0) ? simulationMs / steps : 0.0f;
+          if (!incremental)
+          {
+            fullSortMs = stepMs;
+          }
+
+          char name[64];
+          std::snprintf(name, sizeof(name), "%s%s", SORT_MODE_NAMES[mode], incremental ? " (incremental)" : "");
+          std::printf("%-28s %-12s %12.3f %12u %11.1f%%\n", name, SCENE_SHAPE_NAMES[shape], stepMs,
+                      stats.liveParticles, (fullSortMs > 0.0f) ? (1.0f - stepMs / fullSortMs) * 100.0f : 0.0f);
+        }
+      }
+    }
+
+    options.sortMode = 0;
+    options.sceneShape = 0;
+    options.incrementalSort = false;
+    simulation.reset();
+  }
+
+  // Compares the neighbor traversal of steps 5 and 6 per cell and per row range (radix sort only)
+  // on every scene shape. Both run back to back on the same settled scene.
+  void runNeighborBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const auto& times = simulation.times();
+    const auto& stats = simulation.stats();
+    const std::int32_t shapeCount = sizeof(SCENE_SHAPE_NAMES) / sizeof(SCENE_SHAPE_NAMES[0]);
+    constexpr std::uint32_t settleFrames = 60;
+
+    options.sortMode = 1;
+
+    std::printf("%-28s %-12s %14s %12s\n", "Neighbor traversal", "Scene", "Steps 5+6 (ms)", "Saved");
+
+    for (std::int32_t shape = 0; shape < shapeCount; ++shape)
+    {
+      options.sceneShape = shape;
+      options.rowRanges = false;
+      simulation.reset();
+
+      for (std::uint32_t i = 0; i < settleFrames; ++i)
+      {
+        benchmarkFrame(window, camera, simulation);
+      }
+
+      float cellsMs = 0.0f;
+
+      for (const bool rowRanges : { false, true })
+      {
+        options.rowRanges = rowRanges;
+        float neighborMs = 0.0f;
+        std::uint32_t steps = 0;
+
+        for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+        {
+          benchmarkFrame(window, camera, simulation);
+          neighborMs += times.simStep5Ms + times.simStep6Ms;
+          steps += stats.substeps;
+        }
+
+        const float stepMs = (steps > 0) ? neighborMs / steps : 0.0f;
+        if (!rowRanges)
+        {
+          cellsMs = stepMs;
+        }
+
+        std::printf("%-28s %-12s %14.3f %11.1f%%\n", rowRanges ? "Row ranges (9)" : "Cells (27)", SCENE_SHAPE_NAMES[shape],
+                    stepMs, (cellsMs > 0.0f) ? (1.0f - stepMs / cellsMs) * 100.0f : 0.0f);
+      }
+    }
+
+    options.sortMode = 0;
+    options.sceneShape = 0;
+    options.rowRanges = true;
+    simulation.reset();
+  }
+
+  // Extracts the surface mesh of the same (frozen) particle state at several iso values.
+  void runMeshBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    auto& options = simulation.options();
+    const auto& times = simulation.times();
+    const float isoValues[] = { 0.3f, 0.6f, 1.2f };
+
+    options.shadingMode = 2;
+    simulation.setIntegrationsPerFrame(0);
+
+    std::printf("%-24s %12s %12s\n", "Mesh iso value", "Mesh (ms)", "Triangles");
+
+    for (const float isoValue : isoValues)
+    {
+      options.meshIsoValue = isoValue;
+
+      for (std::uint32_t i = 0; i < BENCHMARK_SETTLE_FRAMES; ++i)
+      {
+        benchmarkFrame(window, camera, simulation);
+      }
+
+      float meshMs = 0.0f;
+
+      for (std::uint32_t i = 0; i < BENCHMARK_FRAMES; ++i)
+      {
+        benchmarkFrame(window, camera, simulation);
+        meshMs += times.renderGeometryMs;
+      }
+
+      const std::uint32_t triangles = simulation.meshTriangleCount();
+
+      std::printf("%-24.2f %12.3f %12u\n", isoValue, meshMs / BENCHMARK_FRAMES, triangles);
+    }
+  }
+
+  // Tuned work group sizes are only valid for the GPU and driver they were measured on.
+  std::string gpuKey()
+  {
+    const auto glString = [](GLenum name) { return std::string(reinterpret_cast<const char*>(glGetString(name))); };
+    return glString(GL_VENDOR) + " / " + glString(GL_RENDERER) + " / " + glString(GL_VERSION);
+  }
+
+  // The cache has one line per GPU: particle group size, grid group size (x y z) and the GPU key.
+  // The cache is hand-editable, so sizes the driver cannot launch are rejected. The timestep
+  // reduction also needs a power of two particle group size.
+  bool validWorkGroups(const flut::Simulation::WorkGroupSizes& workGroups)
+  {
+    GLint maxInvocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+
+    for (GLuint i = 0; i < 3; ++i)
+    {
+      GLint maxSize = 0;
+      glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, i, &maxSize);
+
+      if (workGroups.grid[i] < 1 || workGroups.grid[i] > maxSize ||
+          (i == 0 && workGroups.particle > static_cast<std::uint32_t>(maxSize)))
+      {
+        return false;
+      }
+    }
+
+    const std::uint32_t particle = workGroups.particle;
+    if (particle == 0 || (particle & (particle - 1)) != 0 || particle > static_cast<std::uint32_t>(maxInvocations))
+    {
+      return false;
+    }
+
+    return workGroups.grid.x * workGroups.grid.y * workGroups.grid.z <= maxInvocations;
+  }
+
+  bool loadWorkGroups(const std::string& key, flut::Simulation::WorkGroupSizes& workGroups)
+  {
+    std::ifstream file{WORK_GROUP_CACHE_PATH};
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+      std::istringstream stream{line};
+      flut::Simulation::WorkGroupSizes entry;
+      std::string entryKey;
+
+      if (stream >> entry.particle >> entry.grid.x >> entry.grid.y >> entry.grid.z &&
+          std::getline(stream >> std::ws, entryKey) && entryKey == key)
+      {
+        if (!validWorkGroups(entry))
+        {
+          std::printf("Ignoring invalid work group sizes in %s, using the defaults.\n", WORK_GROUP_CACHE_PATH);
+          return false;
+        }
+
+        workGroups = entry;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void saveWorkGroups(const std::string& key, const flut::Simulation::WorkGroupSizes& workGroups)
+  {
+    std::vector<std::string> lines;
+    std::ifstream input{WORK_GROUP_CACHE_PATH};
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+      if (line.size() < key.size() || line.compare(line.size() - key.size(), key.size(), key) != 0)
+      {
+        lines.push_back(line);
+      }
+    }
+
+    input.close();
+
+    std::ofstream output{WORK_GROUP_CACHE_PATH};
+    for (const std::string& entry : lines)
+    {
+      output << entry << "\n";
+    }
+    output << workGroups.particle << " " << workGroups.grid.x << " " << workGroups.grid.y << " "
+           << workGroups.grid.z << " " << key << "\n";
+
+    if (!output)
+    {
+      throw std::runtime_error(std::string("Unable to write ") + WORK_GROUP_CACHE_PATH);
+    }
+  }
+
+  // GPU time per substep of the particle kernels (steps 1, 3, 5 and 6) and of the grid kernels
+  // (steps 2 and 4), measured on the default scene after it has settled.
+  std::pair<float, float> measureWorkGroups(flut::Window& window, const flut::Camera& camera,
+                                            std::uint32_t width, std::uint32_t height,
+                                            const flut::Simulation::WorkGroupSizes& workGroups)
+  {
+    flut::Simulation simulation{width, height, workGroups};
+    const auto& times = simulation.times();
+    const auto& stats = simulation.stats();
+    simulation.setIntegrationsPerFrame(TUNE_INTEGRATIONS);
+
+    for (std::uint32_t i = 0; i < TUNE_WARMUP_FRAMES; ++i)
+    {
+      window.pollEvents();
+      simulation.render(camera, simulation.timestep() * TUNE_INTEGRATIONS);
+      window.swap();
+    }
+
+    float particleMs = 0.0f;
+    float gridMs = 0.0f;
+    std::uint32_t steps = 0;
+
+    for (std::uint32_t i = 0; i < TUNE_FRAMES; ++i)
+    {
+      window.pollEvents();
+      simulation.render(camera, simulation.timestep() * TUNE_INTEGRATIONS);
+      window.swap();
+      particleMs += times.simStep1Ms + times.simStep3Ms + times.simStep5Ms + times.simStep6Ms;
+      gridMs += times.simStep2Ms + times.simStep4Ms;
+      steps += stats.substeps;
+    }
+
+    return (steps > 0) ? std::make_pair(particleMs / steps, gridMs / steps) : std::make_pair(0.0f, 0.0f);
+  }
+
+  // Times every particle group size with the default grid group size, then every grid group size
+  // with the best particle group size, and returns the fastest combination.
+  flut::Simulation::WorkGroupSizes runTuning(flut::Window& window, const flut::Camera& camera,
+                                             std::uint32_t width, std::uint32_t height)
+  {
+    flut::Simulation::WorkGroupSizes best;
+    float bestMs = FLT_MAX;
+
+    std::printf("%-24s %16s %16s\n", "Work group size", "Particle (ms)", "Grid (ms)");
+
+    for (const std::uint32_t size : PARTICLE_GROUP_CANDIDATES)
+    {
+      flut::Simulation::WorkGroupSizes workGroups = best;
+      workGroups.particle = size;
+      const auto [particleMs, gridMs] = measureWorkGroups(window, camera, width, height, workGroups);
+
+      char name[64];
+      std::snprintf(name, sizeof(name), "Particle %u", size);
+      std::printf("%-24s %16.4f %16.4f\n", name, particleMs, gridMs);
+
+      if (particleMs < bestMs)
+      {
+        bestMs = particleMs;
+        best.particle = size;
+      }
+    }
+
+    bestMs = FLT_MAX;
+
+    for (const glm::ivec3& size : GRID_GROUP_CANDIDATES)
+    {
+      flut::Simulation::WorkGroupSizes workGroups = best;
+      workGroups.grid = size;
+      const auto [particleMs, gridMs] = measureWorkGroups(window, camera, width, height, workGroups);
+
+      char name[64];
+      std::snprintf(name, sizeof(name), "Grid %dx%dx%d", size.x, size.y, size.z);
+      std::printf("%-24s %16.4f %16.4f\n", name, particleMs, gridMs);
+
+      if (gridMs < bestMs)
+      {
+        bestMs = gridMs;
+        best.grid = size;
+      }
+    }
+
+    std::printf("Best: particle %u, grid %dx%dx%d (saved to %s)\n", best.particle,
+                best.grid.x, best.grid.y, best.grid.z, WORK_GROUP_CACHE_PATH);
+    return best;
+  }
+
+  void runBenchmark(flut::Window& window, const flut::Camera& camera, flut::Simulation& simulation)
+  {
+    simulation.setIntegrationsPerFrame(5);
+
+    for (std::uint32_t i = 0; i < BENCHMARK_WARMUP_FRAMES; ++i)
+    {
+      benchmarkFrame(window, camera, simulation);
+    }
+
+    runSolverBenchmark(window, camera, simulation);
+    runSortBenchmark(window, camera, simulation);
+    runNeighborBenchmark(window, camera, simulation);
+    runSmoothingBenchmark(window, camera, simulation);
+    runFormatBenchmark(window, camera, simulation);
+    runMeshBenchmark(window, camera, simulation);
+  }
+}
+
 int main(int argc, char* argv[])
 {
   constexpr std::uint32_t WIDTH = 1200;
   constexpr std::uint32_t HEIGHT = 800;
 
-  flut::Window window{"flut", WIDTH, HEIGHT};
+  bool benchmark = false;
+  bool bindless = true;
+  bool tune = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!std::strcmp(argv[i], "--benchmark"))
+    {
+      benchmark = true;
+    }
+    else if (!std::strcmp(argv[i], "--no-bindless"))
+    {
+      bindless = false;
+    }
+    else if (!std::strcmp(argv[i], "--tune"))
+    {
+      tune = true;
+    }
+  }
+
+  flut::Window window{"flut", WIDTH, HEIGHT, bindless};
   flut::Camera camera{window};
-  flut::Simulation simulation{WIDTH, HEIGHT};
+
+  if (tune)
+  {
+    saveWorkGroups(gpuKey(), runTuning(window, camera, WIDTH, HEIGHT));
+    return EXIT_SUCCESS;
+  }
+
+  flut::Simulation::WorkGroupSizes workGroups;
+  if (loadWorkGroups(gpuKey(), workGroups))
+  {
+    std::printf("Tuned work group sizes loaded (particle %u, grid %dx%dx%d).\n", workGroups.particle,
+                workGroups.grid.x, workGroups.grid.y, workGroups.grid.z);
+  }
+
+  flut::Simulation simulation{WIDTH, HEIGHT, workGroups};
 
   window.resize([&](std::uint32_t width, std::uint32_t height) {
     simulation.resize(width, height);
   });
 
+  if (benchmark)
+  {
+    runBenchmark(window, camera, simulation);
+    return EXIT_SUCCESS;
+  }
+
   auto& options = simulation.options();
   auto& times = simulation.times();
+  auto& stats = simulation.stats();
   using clock = std::chrono::high_resolution_clock;
   auto lastTime = clock::now();
 
@@ -54,8 +718,8 @@ int main(int argc, char* argv[])
 
     const float frameTime = times.simStep1Ms + times.simStep2Ms + times.simStep3Ms + times.simStep4Ms +
                             times.simStep5Ms + times.simStep6Ms + times.renderMs;
-    ImGui::Text("Particles: %d", simulation.PARTICLE_COUNT);
-    ImGui::Text("Delta-time: %f", simulation.DT * options.deltaTimeMod);
+    ImGui::Text("Particles: %d / %d", stats.liveParticles, simulation.PARTICLE_COUNT);
+    ImGui::Text("Delta-time: %f", stats.timestep);
     ImGui::Text("Grid: %dx%dx%d", simulation.GRID_RES.x, simulation.GRID_RES.y, simulation.GRID_RES.z);
     ImGui::Text("Frame: %.2fms (%.2fms)", frameTime, deltaTime * 1000.0f);
 
@@ -63,12 +727,101 @@ int main(int argc, char* argv[])
     ImGui::Text("%.2fms  %.2fms  %.2fms  %.2fms  %.2fms  %.2fms  %.2fms",
                 times.simStep1Ms, times.simStep2Ms, times.simStep3Ms,
                 times.simStep4Ms, times.simStep5Ms, times.simStep6Ms, times.renderMs);
+    ImGui::Text("Geometry %.2fms  Smoothing %.2fms  Shading %.2fms",
+                times.renderGeometryMs, times.renderSmoothMs, times.renderShadingMs);
 
     ImGui::SliderFloat("Delta-Time mod", &options.deltaTimeMod, 0.0f, 2.0f, nullptr, 1.0f);
+    ImGui::Checkbox("Adaptive Timestep", &options.adaptiveTimestep);
+    if (options.adaptiveTimestep)
+    {
+      ImGui::SliderFloat("CFL Number", &options.cflNumber, 0.05f, 1.0f, "%.2f");
+      ImGui::PlotLines("Timestep History", stats.timestepHistory.data(), static_cast<int>(stats.timestepHistory.size()),
+                       0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+    }
+
+    ImGui::DragInt("Max Integrations per Frame", &ipF, 1.0f, 0, 20);
+    ImGui::Text("Integrations: %d  Simulation speed: %.2fx", stats.substeps, stats.simulationSpeed);
+    ImGui::Text("Memory Barriers: %d", stats.barriers);
+    ImGui::Text("Work Groups: particle %u, grid %dx%dx%d", simulation.workGroups().particle,
+                simulation.workGroups().grid.x, simulation.workGroups().grid.y, simulation.workGroups().grid.z);
+    if (stats.subgroupAtomicsSupported)
+    {
+      ImGui::Checkbox("Subgroup Atomics", &options.subgroupAtomics);
+    }
+
+    ImGui::Text("Binning:");
+    ImGui::RadioButton("Counting Sort", &options.sortMode, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("Radix Sort", &options.sortMode, 1);
+    if (options.sortMode == 1)
+    {
+      ImGui::Checkbox("Row Ranges", &options.rowRanges);
+    }
+    if (options.solverMode == 0)
+    {
+      ImGui::Checkbox("Incremental Sort", &options.incrementalSort);
+    }
+    if (options.incrementalSort && options.solverMode == 0)
+    {
+      ImGui::SliderInt("Re-sort Interval", &options.resortInterval, 1, 32);
+      ImGui::SliderFloat("Re-sort Threshold", &options.resortThreshold, 0.001f, 0.2f, "%.3f");
+      ImGui::Text("Stale particles: %.2f%%  Step cost saved: %.0f%%", stats.staleParticleFraction * 100.0f,
+                  stats.sortSavedFraction * 100.0f);
+    }
 
-    ImGui::DragInt("Integrations per Frame", &ipF, 1.0f, 0, 20);
+    ImGui::Text("Solver:");
+    ImGui::RadioButton("SPH", &options.solverMode, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("PCISPH", &options.solverMode, 1);
+    ImGui::SameLine();
+    ImGui::RadioButton("PBF", &options.solverMode, 2);
+    if (options.solverMode == 0)
+    {
+      ImGui::Checkbox("Sleeping", &options.sleeping);
+      if (options.sleeping)
+      {
+        ImGui::SameLine();
+        ImGui::SliderFloat("Wake Speed", &options.sleepSpeed, 0.001f, 0.5f, "%.3f");
+      }
+    }
+    else if (options.solverMode == 1)
+    {
+      ImGui::SliderFloat("Density Error Tolerance", &options.pcisphTolerance, 0.001f, 0.1f, "%.3f");
+    }
+    else if (options.solverMode == 2)
+    {
+      ImGui::SliderInt("Constraint Iterations", &options.pbfIterations, 1, 10);
+    }
+    if (options.solverMode != 0)
+    {
+      ImGui::Text("Iterations per step: %.1f  Density error: %.2f%%", stats.solverIterations, stats.solverDensityError * 100.0f);
+    }
 
     ImGui::DragFloat3("Gravity", &options.gravity[0], 0.075f, -10.0f, 10.0f, nullptr, 1.0f);
+    ImGui::Checkbox("Obstacle", &options.obstacle);
+    ImGui::Checkbox("Emitter", &options.emitter);
+    if (options.emitter)
+    {
+      ImGui::SameLine();
+      ImGui::SliderFloat("Emitter Speed", &options.emitterSpeed, 0.5f, 10.0f, "%.1f");
+    }
+    ImGui::Checkbox("Sink", &options.sink);
+
+    ImGui::Text("Scene:");
+    bool resetScene = false;
+    resetScene |= ImGui::RadioButton("Box", &options.sceneShape, 0);
+    ImGui::SameLine();
+    resetScene |= ImGui::RadioButton("Sphere", &options.sceneShape, 1);
+    ImGui::SameLine();
+    resetScene |= ImGui::RadioButton("Dam", &options.sceneShape, 2);
+    ImGui::SameLine();
+    resetScene |= ImGui::RadioButton("Jet", &options.sceneShape, 3);
+    ImGui::InputInt("Seed", &options.sceneSeed);
+    resetScene |= ImGui::Button("Reset");
+    if (resetScene)
+    {
+      simulation.reset();
+    }
 
     ImGui::Text("Particle Color:");
     ImGui::RadioButton("Initial", &options.colorMode, 0);
@@ -84,6 +837,49 @@ int main(int argc, char* argv[])
     ImGui::RadioButton("Flat", &options.shadingMode, 0);
     ImGui::SameLine();
     ImGui::RadioButton("Fluid", &options.shadingMode, 1);
+    ImGui::SameLine();
+    ImGui::RadioButton("Mesh", &options.shadingMode, 2);
+
+    ImGui::Text("Fluid Smoothing:");
+    ImGui::RadioButton("Curvature Flow", &options.smoothingMode, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("Curvature Flow (Tiled)", &options.smoothingMode, 1);
+    ImGui::RadioButton("Narrow-Range Filter", &options.smoothingMode, 2);
+
+    ImGui::Checkbox("Dynamic Resolution", &options.dynamicResolution);
+    ImGui::SameLine();
+    ImGui::Text("%.0f%% (%dx%d)", stats.renderScale * 100.0f, stats.renderWidth, stats.renderHeight);
+    ImGui::SliderFloat("Target Render Time (ms)", &options.targetRenderMs, 1.0f, 33.0f);
+    ImGui::SliderFloat("Min Render Scale", &options.minRenderScale, 0.25f, 1.0f);
+    ImGui::SliderFloat("Max Render Scale", &options.maxRenderScale, 0.25f, 1.0f);
+
+    ImGui::Text("Render Targets: %.1f MB (pool %.1f MB)", stats.frameMemoryBytes / (1024.0 * 1024.0),
+                stats.renderTargetPoolBytes / (1024.0 * 1024.0));
+    ImGui::RadioButton("RGB32F", &options.colorFormat, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("RGBA8", &options.colorFormat, 1);
+    ImGui::SameLine();
+    ImGui::RadioButton("R11G11B10F", &options.colorFormat, 2);
+    ImGui::RadioButton("R32F", &options.smoothingFormat, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("R16F (1 - z)", &options.smoothingFormat, 1);
+    ImGui::SameLine();
+    ImGui::RadioButton("R16 (linear)", &options.smoothingFormat, 2);
+
+    ImGui::SliderFloat("Mesh Iso Value", &options.meshIsoValue, 0.05f, 3.0f);
+
+    if (ImGui::Button("Export Mesh"))
+    {
+      try
+      {
+        const std::uint32_t triangles = simulation.exportMesh(MESH_EXPORT_PATH);
+        std::cout << "Exported " << triangles << " triangles to " << MESH_EXPORT_PATH << std::endl;
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << e.what() << std::endl;
+      }
+    }
 
     ImGui::End();
 